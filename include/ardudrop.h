@@ -24,12 +24,22 @@
 #ifndef __ARDUDROP_H__
 #define __ARDUDROP_H__
 
+#include "board.h" // DEVICE_NUMBERS and the device pin table
+
 #define BAUD_RATE         9600
-#define MAX_INPUT_SIZE      50 // max length of serial command
-#define TIMES_BUFFER_SIZE   40 // max number of tasks within a single command
-#define DEVICE_NUMBERS      14 // how many digital pins should be mapped? 
+#define MAX_FRAME_SIZE     128 // max payload length of binary frames
+#define FRAME_TIMEOUT      100 // ms without data until a binary frame is dropped
+#define RX_BUFFER_SIZE     128 // serial receive ring buffer - power of two, max 256
+#define RX_BUDGET_IDLE      64 // max received bytes parsed per loop while idle
+#define RX_BUDGET_RUNNING    4 // max received bytes parsed per loop while a task runs
+#define TX_BUFFER_SIZE     128 // serial transmit ring buffer - power of two, max 256
+#define SEQ_WINDOW           8 // sequenced commands the host may have in flight - power of two, max 64
 #define MIN_DURATION        10 // default length of tasks in ms
-
-extern const char deviceMapping[DEVICE_NUMBERS];
+#define DEFAULT_EXEC_MODE    1 // 0: polled in main loop, 1: Timer1 interrupt
+#define MAX_SPIN_WINDOW   1000 // us interrupts may stay blocked while spinning towards an edge
+#define SPIN_GAP            10 // us between two spins - Timer0 and the UART are served in between
+#define EEPROM_LATENCY_BASE  0 // latency profiles of all devices, 204 bytes on the Mega, 60 on the Uno
+#define MAX_LATENCY      65535 // us a device may lag behind its pin
+#define CAPTURE_REPORTS      4 // per-round capture reports waiting for the end of a round
 
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+/*
+ * Board profiles - picked from the MCU the firmware is built for,
+ * a profile can be forced with -DBOARD_UNO or -DBOARD_MEGA in build_flags.
+ * Host builds use the Uno profile as the NativeHal models an ATmega328P.
+ */
+#if !defined(BOARD_UNO) && !defined(BOARD_MEGA)
+  #if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+    #define BOARD_MEGA
+  #elif defined(__AVR_ATmega328P__) || !defined(__AVR__)
+    #define BOARD_UNO
+  #else
+    #error "no board profile for this MCU - see include/board.h"
+  #endif
+#endif
+
+#if defined(BOARD_MEGA)
+  #define DEVICE_NUMBERS    50 // digital pins 0-49
+  #define MAX_TASKS         64 // capacity of the staging and the active schedule table, max 127
+  #define MAX_SWEEPS        32 // tasks of a table with sweep steps, max 255
+  #define SEQUENCE_SIZE    512 // bytes of packed compiled actions - a full table at 4 bytes per edge
+  #define TRACE_SIZE        64 // fired actions kept by the edge timing trace, max 255
+  #define EEPROM_SLOT_BASE 256 // first EEPROM byte of schedule slots
+  #define EEPROM_SLOTS       3 // stored schedules, 1093 bytes each - up to byte 3535 of the 4 KB EEPROM
+  #define TRIGGER_PIN        3 // INT5 - hardware trigger input
+  // ICP1 is not routed to a header - Timer5 free-runs as capture timer on ICP5
+  #define CAPTURE_PIN       48 // ICP5
+  #define CAPTURE_TCCRB     TCCR5B
+  #define CAPTURE_TIMSK     TIMSK5
+  #define CAPTURE_TIFR      TIFR5
+  #define CAPTURE_TCNT      TCNT5
+  #define CAPTURE_ICR       ICR5
+  #define CAPTURE_ICES      ICES5
+  #define CAPTURE_ICNC      ICNC5
+  #define CAPTURE_ICIE      ICIE5
+  #define CAPTURE_ICF       ICF5
+  #define CAPTURE_vect      TIMER5_CAPT_vect
+#else
+  #define DEVICE_NUMBERS    14 // digital pins 0-13
+  // the task tables take most of the 2 KB of RAM - about 1.5 KB are static with these sizes
+  #define MAX_TASKS         16 // capacity of the staging and the active schedule table, max 127
+  #define MAX_SWEEPS         4 // tasks of a table with sweep steps, max 255
+  #define SEQUENCE_SIZE    128 // bytes of packed compiled actions - a full table at 4 bytes per edge
+  #define TRACE_SIZE         8 // fired actions kept by the edge timing trace, max 255
+  #define EEPROM_SLOT_BASE  64 // first EEPROM byte of schedule slots
+  #define EEPROM_SLOTS       3 // stored schedules, 277 bytes each - up to byte 895 of the 1 KB EEPROM
+  #define TRIGGER_PIN        3 // INT1 - hardware trigger input
+  // the capture unit of Timer1 - the timer of the schedule
+  #define CAPTURE_PIN        8 // ICP1
+  #define CAPTURE_TCCRB     TCCR1B
+  #define CAPTURE_TIMSK     TIMSK1
+  #define CAPTURE_TIFR      TIFR1
+  #define CAPTURE_TCNT      TCNT1
+  #define CAPTURE_ICR       ICR1
+  #define CAPTURE_ICES      ICES1
+  #define CAPTURE_ICNC      ICNC1
+  #define CAPTURE_ICIE      ICIE1
+  #define CAPTURE_ICF       ICF1
+  #define CAPTURE_vect      TIMER1_CAPT_vect
+#endif
+
+// device output - Arduino pin and its port number and bit mask
+struct DevicePin {
+  unsigned char Pin;
+  unsigned char Port;
+  unsigned char Mask;
+};
+
+extern const DevicePin devicePins[DEVICE_NUMBERS];
+
+#endif
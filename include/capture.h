@@ -0,0 +1,78 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "ardudrop.h"
+
+// capture modes
+#define CAPTURE_OFF 0
+#define CAPTURE_MEASURE 1  // report the measured event of the device every round
+#define CAPTURE_FEEDBACK 2 // and move its on lag towards the measured one
+
+#define CAPTURE_REPORT_SIZE 41 // longest per-round report Q:round:commanded:measured:delta with CR LF
+
+
+// result of one round, reported between the rounds
+struct CaptureReport {
+  unsigned char Round;
+  unsigned long Commanded;
+  long Delta;
+};
+
+
+class Capture
+{
+private:
+  static unsigned char mode;
+  static unsigned char device;
+  static unsigned char edge;
+  static volatile bool waiting;
+  static volatile bool captured;
+  static volatile unsigned long eventTicks;
+  static unsigned char rounds;
+  static unsigned char missed;
+  static long minDelta;
+  static long maxDelta;
+  static long sumDelta;
+  static CaptureReport reports[CAPTURE_REPORTS];
+  static unsigned char reportHead;
+  static unsigned char reportCount;
+  static unsigned short unreported;
+
+public:
+  static void SetMode(const unsigned char newMode, const unsigned char newDevice, const unsigned char newEdge);
+  static bool IsEnabled() { return mode != CAPTURE_OFF; }
+  static unsigned char GetMode() { return mode; }
+  static unsigned char GetDevice() { return device; }
+  static void Clear();
+  static void Arm();
+  static bool Evaluate(const unsigned char round, const unsigned long commanded, long &delta);
+  static void Report();
+  static void Info();
+  static void OnCapture();
+};
+
+
+#endif
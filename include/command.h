@@ -24,9 +24,11 @@
 #ifndef __PROTOCOL_H__
 #define __PROTOCOL_H__
 
+#include "ardudrop.h"
 
 // commands
 #define CMD_SET         'S'
+#define CMD_BATCH       'B'
 #define CMD_RESET       'X'
 #define CMD_RUN         'R'
 #define CMD_CANCEL      'C'
@@ -34,22 +36,98 @@
 #define CMD_HIGH        'H'
 #define CMD_LOW         'L'
 #define CMD_DEBUGLEVEL  'D'
+#define CMD_MODE        'M'
+#define CMD_TRACE       'T'
+#define CMD_COMMIT      'A'
+#define CMD_SLOT        'E'
+#define CMD_PRECISION   'P'
+#define CMD_LATENCY     'K'
+#define CMD_TRIGGER     'G'
+#define CMD_CAPTURE     'Q'
+#define CMD_STATS       'Y'
+#define CMD_WINDOW      'W'
 
 // separators
-#define FIELD_SEPARATOR   ";"
-#define TIME_SEPARATOR    "|"
-#define CHKSUM_SEPARATOR  "^"
-#define CMD_SEPARATOR     "\n"
+#define FIELD_SEPARATOR   ';'
+#define TIME_SEPARATOR    '|'
+#define CHKSUM_SEPARATOR  '^'
+#define DEVICE_SEPARATOR  '/' // next device of a batch set command
+#define CMD_SEPARATOR     '\n'
+#define NEGATIVE_SIGN     '-'
+#define SEQ_PREFIX        '#' // #Sequence; in front of a command requests an ack
+
+// binary frames
+// FrameStart Length Payload[Length] CRC16 - CRC over Length and Payload
+#define FRAME_START     0xA5
+#define CRC16_INIT      0xFFFF
+
+// answers to sequenced commands: +Sequence or -Sequence:Code
+#define NAK_FORMAT      'F' // command malformed or unknown
+#define NAK_CHECKSUM    'C' // checksum of a set command wrong
+#define NAK_LOST        'L' // received bytes lost - command incomplete
+#define NAK_ERROR       'E' // command refused, the logged error tells why
+#define NAK_SEQUENCE    'S' // sequence number out of order - command not executed
 
 // devices
-#define DEVICE_VALVE    "V"
-#define DEVICE_FLASH    "F"
-#define DEVICE_CAMERA   "C"
+#define DEVICE_VALVE    'V'
+#define DEVICE_FLASH    'F'
+#define DEVICE_CAMERA   'C'
+
+// schedule slot operations
+#define SLOT_STORE      'S'
+#define SLOT_LOAD       'L'
+#define SLOT_CHECK      'C'
+
+// parser states
+#define PARSE_COMMAND   0 // waiting for command character
+#define PARSE_FIELD     1 // reading fields separated by ';' or '|'
+#define PARSE_CHKSUM    2 // reading checksum after '^'
+#define PARSE_SKIP      3 // error - discard until end of line
+#define PARSE_SEQUENCE  4 // reading the sequence number after '#'
+
+// fields of a time group in the set command
+#define TIME_OFFSET         0
+#define TIME_DURATION       1
+#define TIME_OFFSET_STEP    2 // optional per round sweep
+#define TIME_DURATION_STEP  3
+
+#define MAX_ARGS        4 // arguments of commands other than set - numbers or mnemonics
 
 
 class Command
 {
 private:
+  static unsigned char parseState;
+  static char command;
+  static unsigned char fieldIdx;
+  static unsigned long value;
+  static bool hasValue;
+  static char mnemonic;
+  static unsigned long args[MAX_ARGS];
+  static unsigned char argCount;
+  static unsigned char setDevice;
+  static unsigned char setTimeField;
+  static unsigned long setOffset;
+  static unsigned long setDuration;
+  static long setOffsetStep;
+  static unsigned long chksumInternal;
+  static unsigned char taskMark;
+  static bool hasSeq;
+  static unsigned char seq;
+  static bool seqSynced;
+  static unsigned char expectedSeq;
+  static char nakCode;
+  static unsigned short errorMark;
+  static char seqResults[SEQ_WINDOW];
+  static bool acceptSequence(const char cmd);
+  static void reply();
+  static void sendReply(const unsigned char number, const char code);
+  static void beginCommand(const char cmd);
+  static bool addDigit(const char c);
+  static const char* endField(const char separator);
+  static const char* endSetField(const char separator);
+  static void endCommand();
+  static void fail(const char* message);
   static void processSetCommand();
   static void processResetCommand();
   static void processRunCommand();
@@ -57,9 +135,25 @@ private:
   static void processInfoCommand();
   static void processHighLowCommand(const unsigned char mode);
   static void processDebugLvlCommand();
+  static void processModeCommand();
+  static void processTraceCommand();
+  static void processPrecisionCommand();
+  static void processLatencyCommand();
+  static void processTriggerCommand();
+  static void processCaptureCommand();
+  static void processStatsCommand();
+  static void processWindowCommand();
+  static void processSlotCommand(const unsigned char op, const unsigned long slot);
+  static void processFrame(const unsigned char* payload, const unsigned char length);
+  static void processSetFrame(const unsigned char* payload, const unsigned char length);
+  static unsigned short readU16(const unsigned char* data);
+  static unsigned long readU32(const unsigned char* data);
 
 public:
-  static void ParseCommand(char* cmd);
+  static void Feed(const char c);
+  static void Abort(const char* message);
+  static bool AtLineStart() { return parseState == PARSE_COMMAND && !hasSeq; }
+  static void ParseFrame(const unsigned char* payload, const unsigned char length);
 };
 
 
@@ -27,17 +27,54 @@
 #define CTRL_STANDBY 0
 #define CTRL_TASKBEGIN 10
 #define CTRL_TASK 11
+#define CTRL_ARMED 12
 #define CTRL_PAUSEBEGIN 20
 #define CTRL_PAUSE 21
 #define CTRL_CANCEL 99
 
 #define MAXMICROS 4294967295
 
+// execution modes
+#define EXEC_POLLED 0
+#define EXEC_TIMER 1
+
+// hardware trigger modes
+#define TRIGGER_OFF 0
+#define TRIGGER_REARM 1   // every round waits for a trigger
+#define TRIGGER_FREERUN 2 // the first round waits, the others follow with the round delay
+
+#include "ardudrop.h"
+
+// task as received from the host - one pulse on one device
+// the steps of a sweeping task are kept apart, most tasks do not sweep
+struct Task {
+  unsigned long Offset;
+  unsigned long Duration;
+  unsigned char Device;
+  unsigned char Steps; // index into the step table, NO_STEPS without
+};
+
+#define NO_STEPS 0xFF
+
+// sweep steps of a task - offset and duration move by them on every further round of a run
+struct TaskSteps {
+  long OffsetStep;
+  long DurationStep;
+};
+
+// compiled schedule entry - all edges of one AVR port at one offset
 struct Action {
   unsigned long Offset;
-  unsigned char Mode;
-  unsigned char Pin;
-  Action *Next;
+  unsigned char Port;
+  unsigned char SetMask;
+  unsigned char ClearMask;
+};
+
+// edge of a task while compiling
+struct TaskEdge {
+  unsigned long Offset;
+  unsigned char Task;
+  bool Set;
 };
 
 
@@ -48,24 +85,81 @@ private:
   static bool taskRunning;
   static bool taskStart;
   static bool taskCancel;
+  static unsigned char execMode;
+  static unsigned char triggerMode;
+  static unsigned char triggerEdge;
+  static volatile bool armed;
+  static volatile bool triggered;
+  static volatile unsigned long triggerTime;
   static unsigned char loopState;
   static unsigned char roundsToGo;
+  static unsigned char roundCount;
   static unsigned long roundDelay;
   static unsigned long timeStart;
-  static Action *firstAction;
-  static Action *currentAction;
-  static void AddAction(Action *newAction);
+  static Task tasks[MAX_TASKS];
+  static unsigned char taskCount;
+  static TaskSteps steps[MAX_SWEEPS];
+  static unsigned char stepCount;
+  static Task activeTasks[MAX_TASKS];
+  static unsigned char activeTaskCount;
+  static TaskSteps activeSteps[MAX_SWEEPS];
+  static unsigned char activeStepCount;
+  static Action nextAction;
+  static unsigned short readPos;
+  static bool actionPending;
+  static bool staged;
+  static bool commitPending;
+  static bool sweeping;
+  static unsigned long lead;
+  static unsigned char overlaps;
+  static unsigned short onLags[DEVICE_NUMBERS];
+  static unsigned short offLags[DEVICE_NUMBERS];
+  static bool lagsChanged;
+  static unsigned long captureTarget;
+  static bool captureFound;
+  static bool Commit();
+  static void Activate();
+  static void Target();
+  static void Rewind();
+  static void StartTimer();
+  static void Measure();
+  static void ArmTrigger();
+  static bool Compile(const unsigned char round);
+  static void Edges(const Task &task, const unsigned char round, unsigned long &setAt, unsigned long &clearAt);
+  static bool edgeBefore(const TaskEdge &edge, const TaskEdge &other);
+  static bool append(const Action &action);
+  static unsigned long Sweep(const unsigned long base, const long step, const unsigned char round);
+  static const TaskSteps &StepsOf(const Task &task);
+  static void Switch(const unsigned char device, const unsigned char mode);
+  static bool IsInput(const unsigned char device);
   static unsigned long GetDeltaT(const unsigned long tStart);
 
 public:
   static void Setup();
   static void Loop();
-  static void AddTask(const unsigned char targetPin, const unsigned long offset, const unsigned long duration);
+  static bool AddTask(const unsigned char device, const unsigned long offset, const unsigned long duration,
+                      const long offsetStep, const long durationStep);
   static void DeleteTasks();
+  static void RevertTasks(const unsigned char count);
+  static unsigned char GetTaskCount() { return taskCount; }
+  static bool IsRunning() { return taskRunning; }
   static void TaskInfo();
   static void ReqRun(const unsigned char rounds, const unsigned long delay);
+  static void ReqCommit();
   static void ReqCancel();
-  static void ReqSwitch(const unsigned char targetPin, const unsigned char mode);
+  static void ReqSwitch(const unsigned char device, const unsigned char mode);
+  static void SetExecMode(const unsigned char mode);
+  static void SetSpinWindow(const unsigned long window);
+  static void SetTrigger(const unsigned char mode, const unsigned char edge);
+  static void OnTrigger();
+  static void TriggerInfo();
+  static void SetCapture(const unsigned char mode, const unsigned char device, const unsigned char edge);
+  static void SetLatency(const unsigned char device, const unsigned short onLag, const unsigned short offLag);
+  static void LatencyInfo(const unsigned char device);
+  static void SaveSlot(const unsigned char slot);
+  static void LoadSlot(const unsigned char slot);
+  static void SlotInfo(const unsigned char slot);
+  static void Fire(const Action &action);
 };
 
 
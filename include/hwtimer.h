@@ -0,0 +1,69 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __HWTIMER_H__
+#define __HWTIMER_H__
+
+#include "controller.h"
+
+// Timer1 runs with prescaler 8
+#define TIMER_TICKS_PER_US (F_CPU / 8000000UL)
+
+
+class HwTimer
+{
+private:
+  static Action current;
+  static unsigned short readPos;
+  static bool pending;
+  static volatile unsigned short overflows;
+  static volatile bool done;
+  static bool clock;
+  static unsigned short spinWindow;
+  static unsigned long spinEdges;
+  static unsigned long spinMissed;
+  static unsigned short spinMaxLate;
+  static unsigned long Ticks();
+  static void Next();
+  static void Restart();
+  static void FireDue();
+  static void record();
+  static void Arm();
+  static void Spin(const unsigned long target);
+
+public:
+  static void Setup();
+  static void Start();
+  static void StartClock();
+  static void Stop();
+  static void KeepClock(const bool keep);
+  static unsigned long Now();
+  static void SetSpinWindow(const unsigned short window);
+  static void SpinInfo();
+  static bool IsDone() { return done; }
+  static void OnCompare();
+  static void OnOverflow();
+};
+
+
+#endif
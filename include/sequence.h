@@ -0,0 +1,58 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __SEQUENCE_H__
+#define __SEQUENCE_H__
+
+#include "controller.h"
+
+// packed action layout
+// Header(u8) Delta(0, 1, 2 or 4 bytes) [SetMask(u8)] [ClearMask(u8)]
+// Header bits 0-3 port, bit 4 set mask follows, bit 5 clear mask follows,
+// bits 6-7 size of Delta - the offset distance to the previous action, little endian
+#define SEQ_PORT        0x0F
+#define SEQ_SET         0x10
+#define SEQ_CLEAR       0x20
+#define SEQ_DELTA_SHIFT 6
+#define SEQ_ACTION_MAX  7 // bytes of the longest action
+#define SEQ_ACTION_TYPICAL 4 // bytes of an action with a 16 bit delta and one mask
+
+
+class Sequence
+{
+private:
+  static unsigned char data[SEQUENCE_SIZE];
+  static unsigned short size;
+  static unsigned short count;
+  static unsigned long lastOffset;
+
+public:
+  static void Clear();
+  static bool Append(const Action &action);
+  static bool Read(unsigned short &pos, Action &action);
+  static unsigned short GetCount() { return count; }
+  static unsigned short GetSize() { return size; }
+};
+
+
+#endif
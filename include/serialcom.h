@@ -31,24 +31,58 @@
 #define WARN 1
 #define INFO 2
 #define DEBUG 3
-#define MINLEVEL 0
+#define MINLEVEL 0xFF // answers to commands - shown at every level, not counted as error
 #define MAXLEVEL 3
 
+// binary frame receiver states
+#define FRAME_IDLE 0
+#define FRAME_LENGTH 1
+#define FRAME_PAYLOAD 2
+#define FRAME_CRC_LOW 3
+#define FRAME_CRC_HIGH 4
+
 
 class SerialCom
 {
 private:
   static bool initDone;
   static char inputChar;
-  static char inputCmd[MAX_INPUT_SIZE];
-  static unsigned char inputIdx;
   static unsigned char logLevel;
+  static unsigned char frameState;
+  static unsigned char frame[MAX_FRAME_SIZE];
+  static unsigned char frameLength;
+  static unsigned char frameIdx;
+  static unsigned short frameCrc;
+  static unsigned short frameCrcReceived;
+  static unsigned long frameTime;
+  static unsigned char rxBuffer[RX_BUFFER_SIZE];
+  static unsigned char rxHead;
+  static unsigned char rxTail;
+  static bool rxLost;
+  static unsigned char rxLostIdx;
+  static unsigned short rxOverflows;
+  static char txBuffer[TX_BUFFER_SIZE];
+  static unsigned char txHead;
+  static unsigned char txTail;
+  static unsigned short txDropped;
+  static unsigned short errors;
+  static void readFrameByte(const unsigned char data);
+  static void drainRx();
+  static void processByte(const unsigned char data);
+  static bool putTx(const char c);
+  static bool putNumber(unsigned long number);
+  static void flushTx();
 public:
   static void Setup();
   static void Loop();
-  static void Log(const unsigned char level, const char* message);
+  static void Receive(const unsigned char data);
+  static void Log(const unsigned char level, const char* format, ...);
   static void SetLogLevel(const unsigned char level);
   static unsigned char GetLogLevel() {return logLevel; }
+  static unsigned short GetRxOverflows() {return rxOverflows; }
+  static unsigned short GetTxDropped() {return txDropped; }
+  static unsigned char GetTxPending() {return (txHead - txTail) & (TX_BUFFER_SIZE - 1); }
+  static unsigned short GetErrors() {return errors; }
 };
 
 
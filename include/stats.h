@@ -0,0 +1,73 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "ardudrop.h"
+
+// deadline policies
+#define DEADLINE_COUNT 0 // only count late edges
+#define DEADLINE_MARK 1  // report rounds with a late edge as bad
+#define DEADLINE_ABORT 2 // cancel the run at the first late edge
+
+// us of loop time in the sums before they are halved - about 18 minutes
+#define STATS_SUM_LIMIT 0x40000000UL
+
+
+class Stats
+{
+private:
+  static unsigned long passes;
+  static unsigned long samples;
+  static unsigned long lastStart;
+  static unsigned long lastSplit;
+  static unsigned long periodSum;
+  static unsigned long maxPeriod;
+  static unsigned long controllerSum;
+  static unsigned long maxController;
+  static unsigned long serialSum;
+  static unsigned long maxSerial;
+  static volatile unsigned long edges;
+  static volatile unsigned long maxLate;
+  static volatile unsigned long missed;
+  static volatile bool roundMissed;
+  static unsigned long badRounds;
+  static unsigned long deadline;
+  static unsigned char policy;
+
+public:
+  static void Reset();
+  static void SetDeadline(const unsigned long newDeadline, const unsigned char newPolicy);
+  static unsigned char GetPolicy() { return policy; }
+  static void Pass(const unsigned long start, const unsigned long split);
+  static void Edge(const unsigned long lateness);
+  static void BeginRound() { roundMissed = false; }
+  static bool RoundMissed() { return roundMissed; }
+  static void BadRound() { badRounds++; }
+  static void Summary();
+  static void Info();
+};
+
+
+#endif
@@ -0,0 +1,62 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __STORAGE_H__
+#define __STORAGE_H__
+
+#include "controller.h"
+
+// schedule slot layout
+// Magic(u8) Count(u8) CRC16(u16) Devices(u8) { Device(u8) Offset(u32) Duration(u32) OffsetStep(i32) DurationStep(i32) }*Count
+// CRC-16/CCITT over Count and the tasks, multi byte fields little endian
+// Devices is DEVICE_NUMBERS of the board that stored the slot - slots of another board are invalid
+#define SLOT_MAGIC        0xD3
+#define SLOT_HEADER_SIZE  5
+#define SLOT_TASK_SIZE   17
+#define SLOT_SIZE         (SLOT_HEADER_SIZE + MAX_TASKS * SLOT_TASK_SIZE)
+
+// latency profile layout
+// Magic(u8) Count(u8) CRC16(u16) { OnLag(u16) OffLag(u16) }*DEVICE_NUMBERS
+#define LATENCY_MAGIC     0xD2
+
+
+class Storage
+{
+private:
+  static unsigned short slotAddress(const unsigned char slot);
+  static unsigned short readU16(const unsigned short address);
+  static unsigned long readU32(const unsigned short address);
+  static void writeU32(const unsigned short address, const unsigned long value);
+  static unsigned short crcU32(unsigned short crc, const unsigned long value);
+
+public:
+  static bool Save(const unsigned char slot, const Task* tasks, const unsigned char count, const TaskSteps* steps);
+  static bool Load(const unsigned char slot, Task* tasks, unsigned char &count, TaskSteps* steps,
+                   unsigned char &stepCount);
+  static bool Verify(const unsigned char slot, unsigned char &count, unsigned short &crc);
+  static void SaveLatency(const unsigned short* onLags, const unsigned short* offLags);
+  static bool LoadLatency(unsigned short* onLags, unsigned short* offLags);
+};
+
+
+#endif
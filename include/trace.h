@@ -0,0 +1,75 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "ardudrop.h"
+
+#define TRACE_BUCKETS 10 // lateness histogram: 0, 1, 2-3, 4-7, ... 128-255, >=256 us
+#define TRACE_TRIGGERS 8 // latest hardware trigger timestamps
+
+// one fired action
+struct TraceEntry {
+  unsigned long Scheduled;
+  unsigned short Lateness;
+  unsigned char Port;
+  unsigned char SetMask;
+  unsigned char ClearMask;
+  unsigned char Round;
+};
+
+// one hardware trigger
+struct TriggerEntry {
+  unsigned long Time;
+  unsigned char Round;
+};
+
+
+class Trace
+{
+private:
+  static bool enabled;
+  static unsigned char round;
+  static TraceEntry entries[TRACE_SIZE];
+  static unsigned char entryIdx;
+  static unsigned long count;
+  static unsigned long sum;
+  static unsigned short minLateness;
+  static unsigned short maxLateness;
+  static unsigned short histogram[TRACE_BUCKETS];
+  static TriggerEntry triggers[TRACE_TRIGGERS];
+  static unsigned long triggerCount;
+
+public:
+  static void Enable(const bool enable);
+  static bool IsEnabled() { return enabled; }
+  static void BeginRound(const unsigned char number) { round = number; }
+  static void Record(const unsigned long scheduled, const unsigned long actual, const unsigned char port,
+    const unsigned char setMask, const unsigned char clearMask);
+  static void Trigger(const unsigned long time);
+  static void Dump();
+};
+
+
+#endif
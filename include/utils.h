@@ -25,5 +25,8 @@
 #define __UTILS_H__ 
  
 unsigned short freeMemory();
+void paintFreeMemory();
+unsigned short minFreeMemory();
+unsigned short crc16Update(unsigned short crc, const unsigned char data);
 
 #endif
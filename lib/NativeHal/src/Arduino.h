@@ -0,0 +1,170 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/*
+ * Arduino stand-in for host builds
+ * Provides the subset of the Arduino/AVR API used by ArduDrop on top of a
+ * virtual clock. Registers are plain variables except for the Timer1
+ * counter and flags which follow the simulated timer.
+ */
+
+#ifndef __ARDUINO_NATIVE_H__
+#define __ARDUINO_NATIVE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+
+#define _BV(bit) (1 << (bit))
+
+// program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+// interrupts - vectors are plain functions called by the virtual clock
+#define ISR(vector, ...) extern "C" void vector(void)
+#define SREG_I 7
+extern volatile uint8_t SREG;
+inline void cli() { SREG &= ~_BV(SREG_I); }
+inline void sei() { SREG |= _BV(SREG_I); }
+
+
+// Timer1 counter - reads and writes follow the virtual clock
+class NativeTimerCount
+{
+public:
+  operator uint16_t() const;
+  NativeTimerCount& operator=(const uint16_t value);
+};
+
+// interrupt flag register - writing a one clears the flag
+class NativeFlagRegister
+{
+private:
+  uint8_t flags;
+public:
+  NativeFlagRegister() : flags(0) {}
+  operator uint8_t() const;
+  NativeFlagRegister& operator=(const uint8_t value) { flags &= ~value; return *this; }
+  void Set(const uint8_t mask) { flags |= mask; }
+  uint8_t Raw() const { return flags; }
+};
+
+// Timer1
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t ICR1;
+extern NativeTimerCount TCNT1;
+extern NativeFlagRegister TIFR1;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define ICES1 6
+#define ICNC1 7
+#define TOIE1 0
+#define OCIE1A 1
+#define ICIE1 5
+#define TOV1 0
+#define OCF1A 1
+#define ICF1 5
+
+// ports of an ATmega328P - digital pins 0-7 PORTD, 8-13 PORTB, 14-19 PORTC
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+#define NUM_DIGITAL_PINS 20
+
+uint8_t digitalPinToPort(const uint8_t pin);
+uint8_t digitalPinToBitMask(const uint8_t pin);
+volatile uint8_t* portOutputRegister(const uint8_t port);
+volatile uint8_t* portModeRegister(const uint8_t port);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// external interrupts INT0 and INT1 on pins 2 and 3
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+
+// serial port - RX and TX are timed by the baud rate on the virtual clock
+class NativeSerial
+{
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(uint8_t data);
+  operator bool() { return true; }
+};
+
+extern NativeSerial Serial;
+
+
+// sketch entry points
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,58 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#include <string.h>
+#include <EEPROM.h>
+
+
+EEPROMClass EEPROM;
+
+// erased EEPROM reads 0xFF
+static uint8_t cells[NATIVE_EEPROM_SIZE];
+
+static struct EEPROMErase {
+  EEPROMErase() { memset(cells, 0xFF, sizeof(cells)); }
+} erase;
+
+
+uint8_t EEPROMClass::read(const int address) {
+  if (address < 0 || address >= NATIVE_EEPROM_SIZE) {
+    return 0xFF;
+  }
+  return cells[address];
+}
+
+
+void EEPROMClass::write(const int address, const uint8_t value) {
+  if (address < 0 || address >= NATIVE_EEPROM_SIZE) {
+    return;
+  }
+  cells[address] = value;
+}
+
+
+void EEPROMClass::update(const int address, const uint8_t value) {
+  if (read(address) != value) {
+    write(address, value);
+  }
+}
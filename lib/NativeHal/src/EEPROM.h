@@ -0,0 +1,49 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/*
+ * EEPROM stand-in for host builds - contents are kept in RAM
+ */
+
+#ifndef __EEPROM_NATIVE_H__
+#define __EEPROM_NATIVE_H__
+
+#include <stdint.h>
+
+#define E2END              0x3FF // last EEPROM address, like the ATmega328P
+#define NATIVE_EEPROM_SIZE (E2END + 1)
+
+
+class EEPROMClass
+{
+public:
+  uint8_t read(const int address);
+  void write(const int address, const uint8_t value);
+  void update(const int address, const uint8_t value);
+  uint16_t length() { return NATIVE_EEPROM_SIZE; }
+};
+
+extern EEPROMClass EEPROM;
+
+
+#endif
@@ -0,0 +1,609 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+#include <Arduino.h>
+
+#include "NativeHal.h"
+
+
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+#define TCNT1_READ_CYCLES 4
+#define ICP1_PIN 8 // PB0
+
+// interrupt vectors defined by the firmware - missing ones stay NULL
+extern "C" void TIMER1_CAPT_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER1_OVF_vect(void) __attribute__((weak));
+
+
+// registers
+volatile uint8_t SREG = _BV(SREG_I);
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint16_t OCR1A = 0;
+volatile uint16_t ICR1 = 0;
+NativeTimerCount TCNT1;
+NativeFlagRegister TIFR1;
+volatile uint8_t PORTB = 0, PORTC = 0, PORTD = 0;
+volatile uint8_t DDRB = 0, DDRC = 0, DDRD = 0;
+
+NativeSerial Serial;
+
+
+// simulation state
+static uint64_t cycles = 0;
+static NativeHal::Hook interruptHook = NULL;
+static NativeHal::Hook clockHook = NULL;
+
+static uint8_t inputLevels[NUM_DIGITAL_PINS]; // driven from outside, HIGH if idle
+static void (*extHandlers[2])(void) = {NULL, NULL};
+static int extModes[2];
+static bool extPending[2];
+static struct {
+  uint64_t At;
+  uint8_t Pin;
+  uint8_t Level;
+} inputEvents[NATIVE_INPUT_EVENTS];
+static size_t inputEventCount = 0;
+
+static uint16_t timer1Count = 0;
+static unsigned long timer1Residual = 0; // cycles since the last timer tick
+
+static unsigned long serialByteCycles = 0; // 0 until Serial.begin()
+static char rxQueue[NATIVE_RX_QUEUE];
+static size_t rxQueueHead = 0, rxQueueCount = 0;
+static char rxBuffer[NATIVE_SERIAL_BUFFER];
+static size_t rxHead = 0, rxCount = 0;
+static uint64_t rxDone = 0; // cycle the byte on the line is complete, 0 if idle
+static unsigned long rxDropped = 0;
+static unsigned long rxRead = 0;
+static char txBuffer[NATIVE_SERIAL_BUFFER];
+static size_t txHead = 0, txCount = 0;
+static uint64_t txDone = 0;
+static char txOutput[NATIVE_RX_QUEUE];
+static size_t txOutputHead = 0, txOutputCount = 0;
+
+
+/*
+ * Timer1
+ */
+static unsigned long timer1Prescaler() {
+  switch (TCCR1B & (_BV(CS12) | _BV(CS11) | _BV(CS10)))
+  {
+  case 1: return 1;
+  case 2: return 8;
+  case 3: return 64;
+  case 4: return 256;
+  case 5: return 1024;
+  default: return 0;
+  }
+}
+
+
+// reading takes two LDS instructions, so a loop polling the counter moves on
+NativeTimerCount::operator uint16_t() const {
+  uint16_t count = timer1Count;
+  NativeHal::AdvanceCycles(TCNT1_READ_CYCLES);
+  return count;
+}
+
+
+NativeTimerCount& NativeTimerCount::operator=(const uint16_t value) {
+  timer1Count = value;
+  timer1Residual = 0;
+  return *this;
+}
+
+
+NativeFlagRegister::operator uint8_t() const {
+  return flags;
+}
+
+
+// ticks until the next compare match or overflow
+static unsigned long timer1TicksToEvent() {
+  unsigned long toCompare = ((uint16_t)(OCR1A - timer1Count - 1)) + 1UL;
+  unsigned long toOverflow = 0x10000UL - timer1Count;
+  return toCompare < toOverflow ? toCompare : toOverflow;
+}
+
+
+// let Timer1 count for the given number of cycles - never past its next event
+static void timer1Run(const uint64_t elapsed) {
+  unsigned long prescaler = timer1Prescaler();
+  if (prescaler == 0) {
+    return;
+  }
+  uint64_t total = timer1Residual + elapsed;
+  unsigned long ticks = total / prescaler;
+  timer1Residual = total % prescaler;
+  if (ticks == 0) {
+    return;
+  }
+  uint16_t before = timer1Count;
+  timer1Count = before + ticks;
+  if ((uint16_t)(OCR1A - before - 1) + 1UL == ticks) {
+    TIFR1.Set(_BV(OCF1A));
+  }
+  if (0x10000UL - before == ticks) {
+    TIFR1.Set(_BV(TOV1));
+  }
+}
+
+
+// cycles until Timer1 raises its next flag
+static uint64_t timer1CyclesToEvent() {
+  unsigned long prescaler = timer1Prescaler();
+  if (prescaler == 0) {
+    return UINT64_MAX;
+  }
+  return (uint64_t)timer1TicksToEvent() * prescaler - timer1Residual;
+}
+
+
+/*
+ * Serial line
+ */
+static void serialStep() {
+  // byte on the RX line complete - the UART drops it if its buffer is full
+  if (rxDone != 0 && cycles >= rxDone) {
+    char data = rxQueue[rxQueueHead];
+    rxQueueHead = (rxQueueHead + 1) % NATIVE_RX_QUEUE;
+    rxQueueCount--;
+    if (rxCount < NATIVE_SERIAL_BUFFER) {
+      rxBuffer[(rxHead + rxCount) % NATIVE_SERIAL_BUFFER] = data;
+      rxCount++;
+    } else {
+      rxDropped++;
+    }
+    rxDone = rxQueueCount > 0 ? rxDone + serialByteCycles : 0;
+  }
+  if (rxDone == 0 && rxQueueCount > 0 && serialByteCycles > 0) {
+    rxDone = cycles + serialByteCycles;
+  }
+  // byte on the TX line complete
+  if (txDone != 0 && cycles >= txDone) {
+    if (txOutputCount < NATIVE_RX_QUEUE) {
+      txOutput[(txOutputHead + txOutputCount) % NATIVE_RX_QUEUE] = txBuffer[txHead];
+      txOutputCount++;
+    }
+    txHead = (txHead + 1) % NATIVE_SERIAL_BUFFER;
+    txCount--;
+    txDone = txCount > 0 ? txDone + serialByteCycles : 0;
+  }
+  if (txDone == 0 && txCount > 0) {
+    txDone = cycles + serialByteCycles;
+  }
+}
+
+
+static uint64_t serialCyclesToEvent() {
+  uint64_t next = UINT64_MAX;
+  if (rxDone != 0 && rxDone - cycles < next) {
+    next = rxDone - cycles;
+  }
+  if (txDone != 0 && txDone - cycles < next) {
+    next = txDone - cycles;
+  }
+  return next;
+}
+
+
+/*
+ * Scheduled input changes
+ */
+static void inputStep() {
+  size_t i = 0;
+  while (i < inputEventCount) {
+    if (inputEvents[i].At <= cycles) {
+      uint8_t pin = inputEvents[i].Pin;
+      uint8_t level = inputEvents[i].Level;
+      inputEvents[i] = inputEvents[--inputEventCount];
+      NativeHal::SetInput(pin, level);
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+}
+
+
+static uint64_t inputCyclesToEvent() {
+  uint64_t next = UINT64_MAX;
+  for (size_t i = 0; i < inputEventCount; i++) {
+    uint64_t wait = inputEvents[i].At > cycles ? inputEvents[i].At - cycles : 0;
+    if (wait < next) {
+      next = wait;
+    }
+  }
+  return next;
+}
+
+
+/*
+ * Interrupts - dispatched by priority while the global flag is set
+ */
+static void callVector(void (*vector)(void)) {
+  SREG &= ~_BV(SREG_I);
+  vector();
+  SREG |= _BV(SREG_I);
+  if (interruptHook != NULL) {
+    interruptHook();
+  }
+}
+
+
+static void dispatchInterrupts() {
+  while (SREG & _BV(SREG_I)) {
+    uint8_t pending = TIFR1.Raw() & TIMSK1;
+    if ((pending & _BV(ICF1)) && TIMER1_CAPT_vect != NULL) {
+      TIFR1 = _BV(ICF1);
+      callVector(TIMER1_CAPT_vect);
+    } else if ((pending & _BV(OCF1A)) && TIMER1_COMPA_vect != NULL) {
+      TIFR1 = _BV(OCF1A);
+      callVector(TIMER1_COMPA_vect);
+    } else if ((pending & _BV(TOV1)) && TIMER1_OVF_vect != NULL) {
+      TIFR1 = _BV(TOV1);
+      callVector(TIMER1_OVF_vect);
+    } else if (extPending[0] && extHandlers[0] != NULL) {
+      extPending[0] = false;
+      callVector(extHandlers[0]);
+    } else if (extPending[1] && extHandlers[1] != NULL) {
+      extPending[1] = false;
+      callVector(extHandlers[1]);
+    } else {
+      return;
+    }
+  }
+}
+
+
+/*
+ * Virtual clock
+ */
+void NativeHal::Reset() {
+  cycles = 0;
+  SREG = _BV(SREG_I);
+  TCCR1A = TCCR1B = TIMSK1 = 0;
+  OCR1A = 0;
+  ICR1 = 0;
+  TIFR1 = 0xFF;
+  timer1Count = 0;
+  timer1Residual = 0;
+  PORTB = PORTC = PORTD = 0;
+  DDRB = DDRC = DDRD = 0;
+  memset(inputLevels, HIGH, sizeof(inputLevels));
+  extHandlers[0] = extHandlers[1] = NULL;
+  extPending[0] = extPending[1] = false;
+  inputEventCount = 0;
+  serialByteCycles = 0;
+  rxQueueHead = rxQueueCount = rxHead = rxCount = 0;
+  rxDone = 0;
+  rxDropped = 0;
+  rxRead = 0;
+  txHead = txCount = txOutputHead = txOutputCount = 0;
+  txDone = 0;
+}
+
+
+uint64_t NativeHal::Cycles() {
+  return cycles;
+}
+
+
+void NativeHal::Advance(const unsigned long us) {
+  AdvanceCycles((uint64_t)us * CYCLES_PER_US);
+}
+
+
+// move the clock forward, stopping at every timer and serial event
+void NativeHal::AdvanceCycles(const uint64_t duration) {
+  if (clockHook != NULL) {
+    clockHook();
+  }
+  uint64_t target = cycles + duration;
+  dispatchInterrupts();
+  while (cycles < target) {
+    uint64_t step = target - cycles;
+    uint64_t toTimer = timer1CyclesToEvent();
+    uint64_t toSerial = serialCyclesToEvent();
+    uint64_t toInput = inputCyclesToEvent();
+    if (toTimer < step) {
+      step = toTimer;
+    }
+    if (toSerial < step) {
+      step = toSerial;
+    }
+    if (toInput < step) {
+      step = toInput;
+    }
+    cycles += step;
+    timer1Run(step);
+    serialStep();
+    inputStep();
+    dispatchInterrupts();
+  }
+}
+
+
+void NativeHal::SetInterruptHook(Hook hook) {
+  interruptHook = hook;
+}
+
+
+void NativeHal::SetClockHook(Hook hook) {
+  clockHook = hook;
+}
+
+
+bool NativeHal::SerialSend(const char* data, const size_t length) {
+  if (rxQueueCount + length > NATIVE_RX_QUEUE) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    rxQueue[(rxQueueHead + rxQueueCount) % NATIVE_RX_QUEUE] = data[i];
+    rxQueueCount++;
+  }
+  serialStep();
+  return true;
+}
+
+
+size_t NativeHal::SerialPending() {
+  return rxQueueCount;
+}
+
+
+size_t NativeHal::SerialReceive(char* data, const size_t length) {
+  size_t count = 0;
+  while (count < length && txOutputCount > 0) {
+    data[count++] = txOutput[txOutputHead];
+    txOutputHead = (txOutputHead + 1) % NATIVE_RX_QUEUE;
+    txOutputCount--;
+  }
+  return count;
+}
+
+
+unsigned long NativeHal::SerialDropped() {
+  return rxDropped;
+}
+
+
+unsigned long NativeHal::SerialRead() {
+  return rxRead;
+}
+
+
+size_t NativeHal::SerialTxPending() {
+  return txCount;
+}
+
+
+/*
+ * Arduino API
+ */
+unsigned long micros() {
+  // the arduino core counts in steps of 4us on a 16MHz AVR
+  return (unsigned long)(cycles / CYCLES_PER_US) & ~3UL;
+}
+
+
+unsigned long millis() {
+  return (unsigned long)(cycles / (F_CPU / 1000UL));
+}
+
+
+void delay(unsigned long ms) {
+  NativeHal::AdvanceCycles((uint64_t)ms * (F_CPU / 1000UL));
+}
+
+
+void delayMicroseconds(unsigned int us) {
+  NativeHal::Advance(us);
+}
+
+
+uint8_t digitalPinToPort(const uint8_t pin) {
+  if (pin < 8) {
+    return PD;
+  }
+  if (pin < 14) {
+    return PB;
+  }
+  if (pin < NUM_DIGITAL_PINS) {
+    return PC;
+  }
+  return NOT_A_PIN;
+}
+
+
+uint8_t digitalPinToBitMask(const uint8_t pin) {
+  if (pin < 8) {
+    return _BV(pin);
+  }
+  if (pin < 14) {
+    return _BV(pin - 8);
+  }
+  return _BV((pin - 14) & 7);
+}
+
+
+volatile uint8_t* portOutputRegister(const uint8_t port) {
+  switch (port)
+  {
+  case PB: return &PORTB;
+  case PC: return &PORTC;
+  case PD: return &PORTD;
+  default: return NULL;
+  }
+}
+
+
+volatile uint8_t* portModeRegister(const uint8_t port) {
+  switch (port)
+  {
+  case PB: return &DDRB;
+  case PC: return &DDRC;
+  case PD: return &DDRD;
+  default: return NULL;
+  }
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  volatile uint8_t *ddr = portModeRegister(digitalPinToPort(pin));
+  if (ddr == NULL) {
+    return;
+  }
+  if (mode == OUTPUT) {
+    *ddr |= digitalPinToBitMask(pin);
+  } else {
+    *ddr &= ~digitalPinToBitMask(pin);
+  }
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  volatile uint8_t *out = portOutputRegister(digitalPinToPort(pin));
+  if (out == NULL) {
+    return;
+  }
+  if (val == LOW) {
+    *out &= ~digitalPinToBitMask(pin);
+  } else {
+    *out |= digitalPinToBitMask(pin);
+  }
+}
+
+
+int digitalRead(uint8_t pin) {
+  volatile uint8_t *out = portOutputRegister(digitalPinToPort(pin));
+  if (out == NULL) {
+    return LOW;
+  }
+  // inputs read the level driven by the host
+  if (!(*portModeRegister(digitalPinToPort(pin)) & digitalPinToBitMask(pin))) {
+    return inputLevels[pin];
+  }
+  return (*out & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode) {
+  if (interruptNum > 1) {
+    return;
+  }
+  extHandlers[interruptNum] = handler;
+  extModes[interruptNum] = mode;
+  extPending[interruptNum] = false;
+}
+
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum > 1) {
+    return;
+  }
+  extHandlers[interruptNum] = NULL;
+  extPending[interruptNum] = false;
+}
+
+
+void NativeHal::SetInput(const uint8_t pin, const uint8_t level) {
+  if (pin >= NUM_DIGITAL_PINS || inputLevels[pin] == level) {
+    return;
+  }
+  inputLevels[pin] = level;
+  // the input capture unit latches the counter on the selected edge
+  if (pin == ICP1_PIN && timer1Prescaler() != 0 && (level == HIGH) == ((TCCR1B & _BV(ICES1)) != 0)) {
+    ICR1 = timer1Count;
+    TIFR1.Set(_BV(ICF1));
+    dispatchInterrupts();
+  }
+  int interruptNum = digitalPinToInterrupt(pin);
+  if (interruptNum == NOT_AN_INTERRUPT || extHandlers[interruptNum] == NULL) {
+    return;
+  }
+  int mode = extModes[interruptNum];
+  if (mode == CHANGE || (mode == RISING && level == HIGH) || (mode == FALLING && level == LOW)) {
+    extPending[interruptNum] = true;
+    dispatchInterrupts();
+  }
+}
+
+
+bool NativeHal::ScheduleInput(const uint8_t pin, const uint8_t level, const uint64_t at) {
+  if (inputEventCount >= NATIVE_INPUT_EVENTS) {
+    return false;
+  }
+  inputEvents[inputEventCount].At = at;
+  inputEvents[inputEventCount].Pin = pin;
+  inputEvents[inputEventCount].Level = level;
+  inputEventCount++;
+  return true;
+}
+
+
+void NativeSerial::begin(unsigned long baud) {
+  // start bit, 8 data bits, stop bit
+  serialByteCycles = F_CPU * 10UL / baud;
+  serialStep();
+}
+
+
+int NativeSerial::available() {
+  return rxCount;
+}
+
+
+int NativeSerial::read() {
+  if (rxCount == 0) {
+    return -1;
+  }
+  char data = rxBuffer[rxHead];
+  rxHead = (rxHead + 1) % NATIVE_SERIAL_BUFFER;
+  rxCount--;
+  rxRead++;
+  return (unsigned char)data;
+}
+
+
+int NativeSerial::availableForWrite() {
+  return NATIVE_SERIAL_BUFFER - 1 - txCount;
+}
+
+
+// like the arduino core this blocks while the buffer is full
+size_t NativeSerial::write(uint8_t data) {
+  if (serialByteCycles == 0) {
+    return 0;
+  }
+  while (availableForWrite() <= 0) {
+    NativeHal::AdvanceCycles(txDone - cycles);
+  }
+  txBuffer[(txHead + txCount) % NATIVE_SERIAL_BUFFER] = data;
+  txCount++;
+  serialStep();
+  return 1;
+}
@@ -0,0 +1,69 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/*
+ * Control interface of the host HAL
+ * Time only moves when Advance() is called. Timer1 interrupts and serial
+ * byte transfers are processed at their exact position on the virtual clock.
+ */
+
+#ifndef __NATIVEHAL_H__
+#define __NATIVEHAL_H__
+
+#include <Arduino.h>
+
+#define NATIVE_SERIAL_BUFFER 64 // size of the simulated UART buffers, like the arduino core
+#define NATIVE_RX_QUEUE    4096 // bytes waiting to be sent by the host
+#define NATIVE_INPUT_EVENTS   8 // input changes scheduled on the virtual clock
+
+
+class NativeHal
+{
+public:
+  typedef void (*Hook)();
+
+  static void Reset();
+  static uint64_t Cycles();
+  static void Advance(const unsigned long us);
+  static void AdvanceCycles(const uint64_t cycles);
+  static void SetInterruptHook(Hook hook);
+  // called before the clock moves - sees every state the firmware left
+  static void SetClockHook(Hook hook);
+
+  // serial stream - host side
+  static bool SerialSend(const char* data, const size_t length);
+  static size_t SerialPending();
+  static size_t SerialReceive(char* data, const size_t length);
+  static unsigned long SerialDropped();
+  static unsigned long SerialRead(); // bytes taken by the firmware
+  static size_t SerialTxPending(); // bytes written by the firmware, not yet sent
+
+  // level driven onto a digital input pin - edges trigger attached interrupts
+  // and the Timer1 input capture on pin 8
+  static void SetInput(const uint8_t pin, const uint8_t level);
+  // the same at an exact cycle - false if too many changes are waiting
+  static bool ScheduleInput(const uint8_t pin, const uint8_t level, const uint64_t at);
+};
+
+
+#endif
@@ -0,0 +1,132 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/*
+ * Default entry point of host builds
+ * Feeds stdin into the serial port, runs setup() and loop() on the virtual
+ * clock and writes everything the firmware sends to stdout.
+ *
+ * usage: program [-t seconds] [-l us] [-g ms] [-c pin:us]
+ *   -t  virtual run time, default 10s
+ *   -l  virtual time consumed by one call of loop(), default 10us
+ *   -g  pull pin 3 (INT1) LOW for 100us every given ms, off by default
+ *   -c  pull pin 8 (ICP1) LOW for 100us the given us after the output pin
+ *       went HIGH - a flash answering its sync pin, off by default
+ */
+
+#include <Arduino.h>
+#include <unistd.h>
+
+#include "NativeHal.h"
+
+
+static bool echoOn = false;
+static uint8_t echoPin = 0;
+static unsigned long echoLag = 0;
+static int echoLevel = LOW;
+
+
+// answer a rising edge of the echoed output on the capture pin
+static void echo() {
+  if (!echoOn) {
+    return;
+  }
+  int level = digitalRead(echoPin);
+  if (level == HIGH && echoLevel == LOW) {
+    uint64_t at = NativeHal::Cycles() + (uint64_t)echoLag * (F_CPU / 1000000UL);
+    NativeHal::ScheduleInput(8, LOW, at);
+    NativeHal::ScheduleInput(8, HIGH, at + 100 * (F_CPU / 1000000UL));
+  }
+  echoLevel = level;
+}
+
+
+int main(int argc, char** argv) __attribute__((weak));
+
+int main(int argc, char** argv) {
+  unsigned long runTime = 10;
+  unsigned long loopTime = 10;
+  unsigned long triggerPeriod = 0;
+  int option;
+  while ((option = getopt(argc, argv, "t:l:g:c:")) != -1) {
+    switch (option)
+    {
+    case 't':
+      runTime = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      loopTime = strtoul(optarg, NULL, 10);
+      break;
+    case 'g':
+      triggerPeriod = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      if (sscanf(optarg, "%hhu:%lu", &echoPin, &echoLag) != 2) {
+        fprintf(stderr, "%s: -c expects pin:us\n", argv[0]);
+        return 1;
+      }
+      echoOn = true;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t seconds] [-l us] [-g ms] [-c pin:us]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  NativeHal::Reset();
+  NativeHal::SetInterruptHook(echo);
+  setup();
+  char buffer[256];
+  char output[256];
+  size_t buffered = 0;
+  bool inputDone = false;
+  uint64_t end = (uint64_t)runTime * F_CPU;
+  while (NativeHal::Cycles() < end) {
+    // pass stdin to the serial line as the queue has room
+    if (!inputDone && buffered == 0) {
+      ssize_t count = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+      if (count <= 0) {
+        inputDone = true;
+      } else {
+        buffered = count;
+      }
+    }
+    if (buffered > 0 && NativeHal::SerialSend(buffer, buffered)) {
+      buffered = 0;
+    }
+    // trigger pulses on pin 3
+    if (triggerPeriod > 0) {
+      uint64_t phase = NativeHal::Cycles() % ((uint64_t)triggerPeriod * (F_CPU / 1000UL));
+      NativeHal::SetInput(3, phase < 100 * (F_CPU / 1000000UL) ? LOW : HIGH);
+    }
+    loop();
+    echo();
+    NativeHal::Advance(loopTime);
+    size_t received;
+    while ((received = NativeHal::SerialReceive(output, sizeof(output))) > 0) {
+      fwrite(output, 1, received, stdout);
+    }
+  }
+  fflush(stdout);
+  return 0;
+}
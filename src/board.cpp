@@ -0,0 +1,53 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+
+#include "board.h"
+
+
+// device number -> pin, port and mask, resolved at compile time so no edge
+// has to look up the port of a pin
+#if defined(BOARD_MEGA)
+extern constexpr DevicePin devicePins[] = {
+  { 0, PE, _BV(0)}, { 1, PE, _BV(1)}, { 2, PE, _BV(4)}, { 3, PE, _BV(5)}, { 4, PG, _BV(5)},
+  { 5, PE, _BV(3)}, { 6, PH, _BV(3)}, { 7, PH, _BV(4)}, { 8, PH, _BV(5)}, { 9, PH, _BV(6)},
+  {10, PB, _BV(4)}, {11, PB, _BV(5)}, {12, PB, _BV(6)}, {13, PB, _BV(7)}, {14, PJ, _BV(1)},
+  {15, PJ, _BV(0)}, {16, PH, _BV(1)}, {17, PH, _BV(0)}, {18, PD, _BV(3)}, {19, PD, _BV(2)},
+  {20, PD, _BV(1)}, {21, PD, _BV(0)}, {22, PA, _BV(0)}, {23, PA, _BV(1)}, {24, PA, _BV(2)},
+  {25, PA, _BV(3)}, {26, PA, _BV(4)}, {27, PA, _BV(5)}, {28, PA, _BV(6)}, {29, PA, _BV(7)},
+  {30, PC, _BV(7)}, {31, PC, _BV(6)}, {32, PC, _BV(5)}, {33, PC, _BV(4)}, {34, PC, _BV(3)},
+  {35, PC, _BV(2)}, {36, PC, _BV(1)}, {37, PC, _BV(0)}, {38, PD, _BV(7)}, {39, PG, _BV(2)},
+  {40, PG, _BV(1)}, {41, PG, _BV(0)}, {42, PL, _BV(7)}, {43, PL, _BV(6)}, {44, PL, _BV(5)},
+  {45, PL, _BV(4)}, {46, PL, _BV(3)}, {47, PL, _BV(2)}, {48, PL, _BV(1)}, {49, PL, _BV(0)},
+};
+#else
+extern constexpr DevicePin devicePins[] = {
+  { 0, PD, _BV(0)}, { 1, PD, _BV(1)}, { 2, PD, _BV(2)}, { 3, PD, _BV(3)}, { 4, PD, _BV(4)},
+  { 5, PD, _BV(5)}, { 6, PD, _BV(6)}, { 7, PD, _BV(7)}, { 8, PB, _BV(0)}, { 9, PB, _BV(1)},
+  {10, PB, _BV(2)}, {11, PB, _BV(3)}, {12, PB, _BV(4)}, {13, PB, _BV(5)},
+};
+#endif
+
+static_assert(sizeof(devicePins) / sizeof(devicePins[0]) == DEVICE_NUMBERS, "board table does not match DEVICE_NUMBERS");
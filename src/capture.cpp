@@ -0,0 +1,210 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+
+#include "capture.h"
+#include "hwtimer.h"
+#include "serialcom.h"
+
+
+// init static members
+unsigned char Capture::mode = CAPTURE_OFF;
+unsigned char Capture::device = 0;
+unsigned char Capture::edge = 0;
+volatile bool Capture::waiting = false;
+volatile bool Capture::captured = false;
+volatile unsigned long Capture::eventTicks = 0;
+unsigned char Capture::rounds = 0;
+unsigned char Capture::missed = 0;
+long Capture::minDelta = 0;
+long Capture::maxDelta = 0;
+long Capture::sumDelta = 0;
+CaptureReport Capture::reports[CAPTURE_REPORTS];
+unsigned char Capture::reportHead = 0;
+unsigned char Capture::reportCount = 0;
+unsigned short Capture::unreported = 0;
+
+
+/*
+ * Map the capture input to a device
+ * The first edge on CAPTURE_PIN after a round started is the real event of
+ * the device, e.g. the sync contact of a flash or a photodiode.
+ * edge 0 captures a falling, 1 a rising edge
+ */
+void Capture::SetMode(const unsigned char newMode, const unsigned char newDevice, const unsigned char newEdge) {
+  unsigned char oldSREG = SREG;
+  cli();
+  waiting = false;
+  CAPTURE_TIMSK &= ~_BV(CAPTURE_ICIE);
+  SREG = oldSREG;
+  mode = newMode;
+  device = newDevice;
+  edge = newEdge ? 1 : 0;
+  HwTimer::KeepClock(mode != CAPTURE_OFF);
+  if (mode == CAPTURE_OFF) {
+#if defined(BOARD_MEGA)
+    TCCR5B = 0;
+#endif
+    // the pin is a device output again
+    pinMode(CAPTURE_PIN, OUTPUT);
+    digitalWrite(CAPTURE_PIN, LOW);
+  } else {
+#if defined(BOARD_MEGA)
+    // free running with the prescaler of Timer1 - only the age of a capture is read
+    TCCR5A = 0;
+    TCCR5B = _BV(CS51);
+#endif
+    pinMode(CAPTURE_PIN, INPUT_PULLUP);
+  }
+  Clear();
+}
+
+
+/*
+ * Clear the statistics of the measured rounds
+ */
+void Capture::Clear() {
+  rounds = 0;
+  missed = 0;
+  minDelta = 0;
+  maxDelta = 0;
+  sumDelta = 0;
+  reportCount = 0;
+  unreported = 0;
+}
+
+
+/*
+ * Wait for the event of the round just started - call after Timer1 started
+ */
+void Capture::Arm() {
+  if (mode == CAPTURE_OFF) {
+    return;
+  }
+  unsigned char oldSREG = SREG;
+  cli();
+  // noise canceler on - delays the capture by 4 cpu cycles
+  CAPTURE_TCCRB = (CAPTURE_TCCRB & ~_BV(CAPTURE_ICES)) | _BV(CAPTURE_ICNC) | (edge ? _BV(CAPTURE_ICES) : 0);
+  CAPTURE_TIFR = _BV(CAPTURE_ICF);
+  captured = false;
+  waiting = true;
+  CAPTURE_TIMSK |= _BV(CAPTURE_ICIE);
+  SREG = oldSREG;
+}
+
+
+/*
+ * Compare the event captured in the round with its commanded time in us
+ * since the round started - false if no event was captured
+ * The result is queued, Report sends it once the transmit buffer has room
+ */
+bool Capture::Evaluate(const unsigned char round, const unsigned long commanded, long &delta) {
+  unsigned char oldSREG = SREG;
+  cli();
+  bool found = captured;
+  unsigned long ticks = eventTicks;
+  waiting = false;
+  captured = false;
+  SREG = oldSREG;
+  if (!found) {
+    missed++;
+    SerialCom::Log(WARN, PSTR("round %u: no event of device %u captured"), round, device);
+    return false;
+  }
+  unsigned long measured = ticks / TIMER_TICKS_PER_US;
+  delta = (long)(measured - commanded);
+  if (rounds == 0 || delta < minDelta) {
+    minDelta = delta;
+  }
+  if (rounds == 0 || delta > maxDelta) {
+    maxDelta = delta;
+  }
+  sumDelta += delta;
+  rounds++;
+  if (reportCount < CAPTURE_REPORTS) {
+    CaptureReport &report = reports[(reportHead + reportCount) % CAPTURE_REPORTS];
+    report.Round = round;
+    report.Commanded = commanded;
+    report.Delta = delta;
+    reportCount++;
+  } else {
+    unreported++;
+  }
+  return true;
+}
+
+
+/*
+ * Send the queued per-round results - call between the rounds
+ * A result waits while the transmit buffer has no room for it, so the
+ * serial traffic of a run does not drop it
+ */
+void Capture::Report() {
+  while (reportCount > 0 && TX_BUFFER_SIZE - 1 - SerialCom::GetTxPending() >= CAPTURE_REPORT_SIZE) {
+    CaptureReport &report = reports[reportHead];
+    SerialCom::Log(INFO, PSTR("Q:%u:%lu:%lu:%ld"), report.Round, report.Commanded,
+      report.Commanded + report.Delta, report.Delta);
+    reportHead = (reportHead + 1) % CAPTURE_REPORTS;
+    reportCount--;
+  }
+}
+
+
+/*
+ * Print the setting and the deltas of the measured rounds
+ */
+void Capture::Info() {
+  SerialCom::Log(MINLEVEL, PSTR("Capture mode: %u, device: %u, edge: %u, pin: %u, unreported rounds: %u"), mode, device,
+    edge, CAPTURE_PIN, unreported);
+  long mean = rounds > 0 ? sumDelta / rounds : 0;
+  SerialCom::Log(MINLEVEL, PSTR("Q:%u:%u:%ld:%ld:%ld"), rounds, missed, minDelta, maxDelta, mean);
+}
+
+
+/*
+ * Input capture - the counter was latched by the event, its age on the
+ * capture timer gives the event time on the Timer1 time base
+ */
+void Capture::OnCapture() {
+  CAPTURE_TIMSK &= ~_BV(CAPTURE_ICIE);
+  if (!waiting) {
+    return;
+  }
+  unsigned long now = HwTimer::Now();
+#if defined(BOARD_MEGA)
+  unsigned short age = CAPTURE_TCNT - CAPTURE_ICR;
+#else
+  // Timer1 itself latched the event
+  unsigned short age = (unsigned short)now - CAPTURE_ICR;
+#endif
+  eventTicks = now > age ? now - age : 0;
+  waiting = false;
+  captured = true;
+}
+
+
+ISR(CAPTURE_vect) {
+  Capture::OnCapture();
+}
@@ -27,132 +27,725 @@
 #include "controller.h"
 #include "serialcom.h"
 #include "utils.h"
+#include "trace.h"
+#include "hwtimer.h"
+#include "capture.h"
+#include "stats.h"
 
 
 
 
 
-// check command and call specific subroutine for parsing
-void Command::ParseCommand(char* cmd) {
-  char* cmdToken = strtok(cmd, FIELD_SEPARATOR);
-  switch (cmdToken[0])
+// init static members
+unsigned char Command::parseState = PARSE_COMMAND;
+char Command::command = 0;
+unsigned char Command::fieldIdx = 0;
+unsigned long Command::value = 0;
+bool Command::hasValue = false;
+char Command::mnemonic = 0;
+unsigned long Command::args[MAX_ARGS];
+unsigned char Command::argCount = 0;
+unsigned char Command::setDevice = 0;
+unsigned char Command::setTimeField = TIME_OFFSET;
+unsigned long Command::setOffset = 0;
+unsigned long Command::setDuration = 0;
+long Command::setOffsetStep = 0;
+unsigned long Command::chksumInternal = 0;
+unsigned char Command::taskMark = 0;
+bool Command::hasSeq = false;
+unsigned char Command::seq = 0;
+bool Command::seqSynced = false;
+unsigned char Command::expectedSeq = 0;
+char Command::nakCode = 0;
+unsigned short Command::errorMark = 0;
+char Command::seqResults[SEQ_WINDOW];
+
+
+// feed one character of a text command into the parser
+// fields are validated and converted as soon as their separator arrives
+void Command::Feed(const char c) {
+  if (c == '\r') {
+    return;
+  }
+  switch (parseState)
+  {
+  case PARSE_COMMAND:
+    if (c == SEQ_PREFIX && !hasSeq) {
+      value = 0;
+      hasValue = false;
+      parseState = PARSE_SEQUENCE;
+    } else if (c == CMD_SEPARATOR) {
+      if (hasSeq) {
+        fail(PSTR("Wrong Format"));
+      }
+    } else if (!hasSeq || acceptSequence(c)) {
+      beginCommand(c);
+    } else {
+      parseState = PARSE_SKIP;
+    }
+    break;
+  case PARSE_SEQUENCE:
+    if (c >= '0' && c <= '9') {
+      if (!addDigit(c) || value > 0xFF) {
+        fail(PSTR("Wrong Format"));
+      }
+    } else if (c == FIELD_SEPARATOR && hasValue) {
+      seq = value;
+      hasSeq = true;
+      parseState = PARSE_COMMAND;
+    } else {
+      fail(PSTR("Wrong Format"));
+    }
+    break;
+  case PARSE_FIELD:
+    if (c >= '0' && c <= '9') {
+      if (!addDigit(c)) {
+        fail(PSTR("Wrong Format"));
+      }
+    } else if (c == FIELD_SEPARATOR || c == TIME_SEPARATOR || c == CHKSUM_SEPARATOR || c == CMD_SEPARATOR ||
+               c == DEVICE_SEPARATOR) {
+      const char* error = endField(c);
+      if (error != NULL) {
+        fail(error);
+      } else if (c == CHKSUM_SEPARATOR) {
+        parseState = PARSE_CHKSUM;
+      } else if (c == CMD_SEPARATOR) {
+        endCommand();
+      }
+    } else if (!hasValue && mnemonic == 0) {
+      mnemonic = c;
+    } else {
+      fail(PSTR("Wrong Format"));
+    }
+    break;
+  case PARSE_CHKSUM:
+    if (c >= '0' && c <= '9') {
+      if (!addDigit(c)) {
+        fail(PSTR("Wrong Format"));
+      }
+    } else if (c == CMD_SEPARATOR) {
+      endCommand();
+    } else {
+      fail(PSTR("Wrong Format"));
+    }
+    break;
+  default:
+    break;
+  }
+  // a failed command is discarded up to the end of its line
+  if (parseState == PARSE_SKIP && c == CMD_SEPARATOR) {
+    parseState = PARSE_COMMAND;
+  }
+}
+
+
+// discard the command currently parsed, e.g. after received bytes were lost
+void Command::Abort(const char* message) {
+  nakCode = NAK_LOST;
+  fail(message);
+}
+
+
+// check the sequence number of a command - false if it must not be executed
+// the first sequenced command and every window command synchronize the numbering,
+// a repeated command within the window is answered again with its stored result
+// - the results are cleared on sync, so numbers from before it are refused
+bool Command::acceptSequence(const char cmd) {
+  if (!seqSynced || cmd == CMD_WINDOW) {
+    seqSynced = true;
+    expectedSeq = seq;
+    for (unsigned char i = 0; i < SEQ_WINDOW; i++) {
+      seqResults[i] = NAK_SEQUENCE;
+    }
+  }
+  nakCode = 0;
+  if (seq == expectedSeq) {
+    return true;
+  }
+  hasSeq = false;
+  unsigned char behind = expectedSeq - seq;
+  if (behind <= SEQ_WINDOW) {
+    SerialCom::Log(DEBUG, PSTR("repeated command %u"), seq);
+    sendReply(seq, seqResults[seq & (SEQ_WINDOW - 1)]);
+  } else {
+    sendReply(seq, NAK_SEQUENCE);
+  }
+  return false;
+}
+
+
+// answer a sequenced command once it is executed or discarded
+// damaged commands keep their number for the retransmission, all others consume it
+void Command::reply() {
+  char code = nakCode;
+  nakCode = 0;
+  if (!hasSeq) {
+    return;
+  }
+  hasSeq = false;
+  if (code == 0 && SerialCom::GetErrors() != errorMark) {
+    code = NAK_ERROR;
+  }
+  if (code != NAK_CHECKSUM && code != NAK_LOST) {
+    seqResults[seq & (SEQ_WINDOW - 1)] = code;
+    expectedSeq = seq + 1;
+  }
+  sendReply(seq, code);
+}
+
+
+// +Sequence acknowledges a command, -Sequence:Code refuses it
+void Command::sendReply(const unsigned char number, const char code) {
+  if (code == 0) {
+    SerialCom::Log(MINLEVEL, PSTR("+%u"), number);
+  } else {
+    SerialCom::Log(MINLEVEL, PSTR("-%u:%c"), number, code);
+  }
+}
+
+
+// start parsing a new command
+// errors logged from here on refuse a sequenced command, also those of tasks added while parsing
+void Command::beginCommand(const char cmd) {
+  errorMark = SerialCom::GetErrors();
+  command = cmd;
+  fieldIdx = 0;
+  value = 0;
+  hasValue = false;
+  mnemonic = 0;
+  argCount = 0;
+  setTimeField = TIME_OFFSET;
+  chksumInternal = 0;
+  parseState = PARSE_FIELD;
+  switch (command)
+  {
+  case CMD_SET:
+    SerialCom::Log(DEBUG, PSTR("received set command"));
+    taskMark = Controller::GetTaskCount();
+    break;
+  case CMD_BATCH:
+    SerialCom::Log(DEBUG, PSTR("received batch set command"));
+    taskMark = Controller::GetTaskCount();
+    break;
+  case CMD_RESET:
+    SerialCom::Log(DEBUG, PSTR("received reset command"));
+    break;
+  case CMD_RUN:
+    SerialCom::Log(DEBUG, PSTR("received run command"));
+    break;
+  case CMD_CANCEL:
+    SerialCom::Log(DEBUG, PSTR("recieved cancel command"));
+    break;
+  case CMD_INFO:
+    SerialCom::Log(DEBUG, PSTR("received info command"));
+    break;
+  case CMD_HIGH:
+    SerialCom::Log(DEBUG, PSTR("received high command"));
+    break;
+  case CMD_LOW:
+    SerialCom::Log(DEBUG, PSTR("received low command"));
+    break;
+  case CMD_DEBUGLEVEL:
+    SerialCom::Log(DEBUG, PSTR("recieved set debuglevel command"));
+    break;
+  case CMD_MODE:
+    SerialCom::Log(DEBUG, PSTR("received set mode command"));
+    break;
+  case CMD_TRACE:
+    SerialCom::Log(DEBUG, PSTR("received trace command"));
+    break;
+  case CMD_COMMIT:
+    SerialCom::Log(DEBUG, PSTR("received commit command"));
+    break;
+  case CMD_SLOT:
+    SerialCom::Log(DEBUG, PSTR("received slot command"));
+    break;
+  case CMD_PRECISION:
+    SerialCom::Log(DEBUG, PSTR("received precision command"));
+    break;
+  case CMD_LATENCY:
+    SerialCom::Log(DEBUG, PSTR("received latency command"));
+    break;
+  case CMD_TRIGGER:
+    SerialCom::Log(DEBUG, PSTR("received trigger command"));
+    break;
+  case CMD_CAPTURE:
+    SerialCom::Log(DEBUG, PSTR("received capture command"));
+    break;
+  case CMD_STATS:
+    SerialCom::Log(DEBUG, PSTR("received stats command"));
+    break;
+  case CMD_WINDOW:
+    SerialCom::Log(DEBUG, PSTR("received window command"));
+    break;
+  default:
+    SerialCom::Log(WARN, PSTR("Command not found"));
+    parseState = PARSE_SKIP;
+    nakCode = NAK_FORMAT;
+    reply();
+  }
+}
+
+
+// append a decimal digit to the current field, false on overflow
+bool Command::addDigit(const char c) {
+  unsigned char digit = c - '0';
+  if (value > (0xFFFFFFFFUL - digit) / 10) {
+    return false;
+  }
+  value = value * 10 + digit;
+  hasValue = true;
+  return true;
+}
+
+
+// report an error and discard the rest of the command
+void Command::fail(const char* message) {
+  SerialCom::Log(ERROR, message);
+  // drop tasks of a broken set command
+  if (command == CMD_SET || command == CMD_BATCH) {
+    Controller::RevertTasks(taskMark);
+  }
+  parseState = PARSE_SKIP;
+  if (nakCode == 0) {
+    nakCode = NAK_FORMAT;
+  }
+  reply();
+}
+
+
+// finish the current field - returns an error message or NULL
+const char* Command::endField(const char separator) {
+  const char* error = NULL;
+  if (separator == DEVICE_SEPARATOR && command != CMD_BATCH) {
+    error = PSTR("Wrong Format");
+  } else if (fieldIdx == 0) {
+    // nothing may follow the command character but a separator
+    if (hasValue || mnemonic != 0 || separator == TIME_SEPARATOR || separator == CHKSUM_SEPARATOR ||
+        separator == DEVICE_SEPARATOR) {
+      error = PSTR("Wrong Format");
+    }
+  } else if (command == CMD_SET) {
+    error = endSetField(separator);
+  } else if (command == CMD_BATCH) {
+    // a device ends like a set command, the next one starts with its number
+    error = endSetField(separator == DEVICE_SEPARATOR ? CHKSUM_SEPARATOR : separator);
+    if (separator == DEVICE_SEPARATOR) {
+      fieldIdx = 0;
+    }
+  } else if ((hasValue && mnemonic != 0) || separator == TIME_SEPARATOR || separator == CHKSUM_SEPARATOR) {
+    error = PSTR("Wrong Format");
+  } else if (hasValue || mnemonic != 0) {
+    // a mnemonic is passed as its character code
+    if (argCount >= MAX_ARGS) {
+      error = PSTR("Wrong Format");
+    } else {
+      args[argCount++] = hasValue ? value : (unsigned char)mnemonic;
+    }
+  } else if (separator != CMD_SEPARATOR) {
+    // only a trailing field may be empty
+    error = PSTR("Wrong Format");
+  }
+  if (fieldIdx < 255) {
+    fieldIdx++;
+  }
+  value = 0;
+  hasValue = false;
+  mnemonic = 0;
+  return error;
+}
+
+
+// finish a field of the set command - tasks are added as soon as a time group is complete
+// DeviceNumber;DeviceType;StartTime|Duration[|OffsetStep|DurationStep][;...]*^Checksum
+// steps may be negative, the checksum adds their absolute values
+const char* Command::endSetField(const char separator) {
+  switch (fieldIdx)
+  {
+  case 1:
+    if (!hasValue || mnemonic != 0 || separator != FIELD_SEPARATOR) {
+      return PSTR("Wrong Format");
+    }
+    // is the target device available
+    if (value > DEVICE_NUMBERS - 1) {
+      return PSTR("Wrong device number");
+    }
+    setDevice = value;
+    return NULL;
+  case 2:
+    if (hasValue || (mnemonic != DEVICE_VALVE && mnemonic != DEVICE_FLASH && mnemonic != DEVICE_CAMERA)) {
+      return PSTR("Wrong Format");
+    }
+    if (separator != FIELD_SEPARATOR && separator != CHKSUM_SEPARATOR) {
+      return PSTR("Wrong Format");
+    }
+    return NULL;
+  default:
+    break;
+  }
+  // only steps may be negative
+  if (mnemonic != 0 && (setTimeField < TIME_OFFSET_STEP || mnemonic != NEGATIVE_SIGN)) {
+    return PSTR("Wrong Format");
+  }
+  long step = 0;
+  switch (setTimeField)
+  {
+  case TIME_OFFSET:
+    // an empty field is allowed after the last pair
+    if (!hasValue) {
+      return (separator == CHKSUM_SEPARATOR) ? NULL : PSTR("Wrong Format");
+    }
+    if (separator != TIME_SEPARATOR) {
+      return PSTR("Wrong Format");
+    }
+    setOffset = value;
+    chksumInternal += value;
+    setTimeField = TIME_DURATION;
+    return NULL;
+  case TIME_DURATION:
+    if (!hasValue || separator == CMD_SEPARATOR) {
+      return PSTR("Wrong Format");
+    }
+    // limit duration to sane values and update checksum
+    chksumInternal += value;
+    setDuration = value > 0 ? value : MIN_DURATION;
+    setOffsetStep = 0;
+    if (separator == TIME_SEPARATOR) {
+      setTimeField = TIME_OFFSET_STEP;
+      return NULL;
+    }
+    break;
+  case TIME_OFFSET_STEP:
+    if (!hasValue || value > 0x7FFFFFFFUL || separator != TIME_SEPARATOR) {
+      return PSTR("Wrong Format");
+    }
+    chksumInternal += value;
+    setOffsetStep = mnemonic == NEGATIVE_SIGN ? -(long)value : (long)value;
+    setTimeField = TIME_DURATION_STEP;
+    return NULL;
+  default:
+    if (!hasValue || value > 0x7FFFFFFFUL || separator == TIME_SEPARATOR || separator == CMD_SEPARATOR) {
+      return PSTR("Wrong Format");
+    }
+    chksumInternal += value;
+    step = mnemonic == NEGATIVE_SIGN ? -(long)value : (long)value;
+    break;
+  }
+  // add new actions to droplet - a refused task discards the whole command
+  if (!Controller::AddTask(setDevice, setOffset, setDuration, setOffsetStep, step)) {
+    nakCode = NAK_ERROR;
+    return PSTR("Set command discarded");
+  }
+  setTimeField = TIME_OFFSET;
+  return NULL;
+}
+
+
+// command line complete - call specific subroutine
+void Command::endCommand() {
+  parseState = PARSE_COMMAND;
+  switch (command)
   {
   case CMD_SET:
-    SerialCom::Log(DEBUG, "received set command");
+  case CMD_BATCH:
     processSetCommand();
     break;
   case CMD_RESET:
-    SerialCom::Log(DEBUG, "received reset command");
     processResetCommand();
     break;
   case CMD_RUN:
-    SerialCom::Log(DEBUG, "received run command");
     processRunCommand();
     break;
   case CMD_CANCEL:
-    SerialCom::Log(DEBUG, "recieved cancel command");
     processCancelCommand();
     break;
   case CMD_INFO:
-    SerialCom::Log(DEBUG, "received info command");
     processInfoCommand();
     break;
   case CMD_HIGH:
-    SerialCom::Log(DEBUG, "received high command");
     processHighLowCommand(HIGH);
     break;
   case CMD_LOW:
-    SerialCom::Log(DEBUG, "received low command");
     processHighLowCommand(LOW);
     break;
   case CMD_DEBUGLEVEL:
-    SerialCom::Log(DEBUG, "recieved set debuglevel command");
     processDebugLvlCommand();
     break;
+  case CMD_MODE:
+    processModeCommand();
+    break;
+  case CMD_TRACE:
+    processTraceCommand();
+    break;
+  case CMD_COMMIT:
+    Controller::ReqCommit();
+    break;
+  case CMD_PRECISION:
+    processPrecisionCommand();
+    break;
+  case CMD_LATENCY:
+    processLatencyCommand();
+    break;
+  case CMD_TRIGGER:
+    processTriggerCommand();
+    break;
+  case CMD_CAPTURE:
+    processCaptureCommand();
+    break;
+  case CMD_STATS:
+    processStatsCommand();
+    break;
+  case CMD_SLOT:
+    if (argCount != 2) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      break;
+    }
+    processSlotCommand(args[0], args[1]);
+    break;
+  case CMD_WINDOW:
+    processWindowCommand();
+    break;
   default:
-    SerialCom::Log(WARN, "Command not found");;
+    break;
   }
+  reply();
 }
 
 
-// parse set command
-// DeviceNumber;DeviceType;StartTime|Duration[;StartTime|Duration]*^Checksum
-void Command::processSetCommand() {
-  unsigned char deviceNumber;
-  char deviceMnemonic;
-  char times[TIMES_BUFFER_SIZE] = "";
-  unsigned long chksum = 0, chksumInternal = 0;
-  unsigned long offset, duration;   
-  // read device info and tasklist
-  if(sscanf(strtok(NULL, CHKSUM_SEPARATOR), "%hhu;%c;%s", &deviceNumber, &deviceMnemonic, times) < 2) {
-    SerialCom::Log(ERROR, "Wrong Format");
-    return;
-  }
-  // read chksum
-  if(sscanf(strtok(NULL, CMD_SEPARATOR), "%lu", &chksum) < 1) {
-    SerialCom::Log(ERROR, "Wrong Format");
-    return;
-  }
-  // is the target device available
-  if(deviceNumber < 0 || deviceNumber > DEVICE_NUMBERS - 1) {
-    SerialCom::Log(ERROR, "Wrong device number");
-    return;
-  }
-  // parse times
-  char *token = strtok(times, FIELD_SEPARATOR);
-  while(token != NULL) {
-    offset = 0,
-    duration = 0;
-    char remain[] = "";
-    // read pair of times
-    if(sscanf(token, "%lu|%lu%s", &offset, &duration, remain) == 3) {
-      SerialCom::Log(ERROR, "Wrong Format");
+// check binary frame and pass it on - a sequenced frame starts with '#' Sequence(u8)
+void Command::ParseFrame(const unsigned char* payload, const unsigned char length) {
+  if (length < 2 || payload[0] != SEQ_PREFIX) {
+    processFrame(payload, length);
+    return;
+  }
+  seq = payload[1];
+  hasSeq = true;
+  if (!acceptSequence(length > 2 ? payload[2] : 0)) {
+    return;
+  }
+  errorMark = SerialCom::GetErrors();
+  processFrame(payload + 2, length - 2);
+  reply();
+}
+
+
+// call specific subroutine of a binary frame
+// payload starts with the command character, fields are little endian
+void Command::processFrame(const unsigned char* payload, const unsigned char length) {
+  if (length < 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  switch (payload[0])
+  {
+  case CMD_SET:
+    SerialCom::Log(DEBUG, PSTR("received set frame"));
+    processSetFrame(payload + 1, length - 1);
+    break;
+  case CMD_RESET:
+    SerialCom::Log(DEBUG, PSTR("received reset frame"));
+    processResetCommand();
+    break;
+  case CMD_RUN:
+    SerialCom::Log(DEBUG, PSTR("received run frame"));
+    if (length != 6) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
       return;
     }
-    // limit offset and duration to sane values and update checksum
-    if(offset >= 0) {
-      chksumInternal += offset;
-    } else {
-      offset = 0;
+    Controller::ReqRun(payload[1], readU32(payload + 2));
+    break;
+  case CMD_CANCEL:
+    SerialCom::Log(DEBUG, PSTR("received cancel frame"));
+    processCancelCommand();
+    break;
+  case CMD_COMMIT:
+    SerialCom::Log(DEBUG, PSTR("received commit frame"));
+    Controller::ReqCommit();
+    break;
+  case CMD_INFO:
+    SerialCom::Log(DEBUG, PSTR("received info frame"));
+    processInfoCommand();
+    break;
+  case CMD_HIGH:
+  case CMD_LOW:
+    SerialCom::Log(DEBUG, PSTR("received high/low frame"));
+    if (length != 2 || payload[1] > DEVICE_NUMBERS - 1) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
     }
-    if(duration > 0) {
-      chksumInternal += duration;
-    } else {
-      duration = MIN_DURATION;
+    Controller::ReqSwitch(payload[1], payload[0] == CMD_HIGH ? HIGH : LOW);
+    break;
+  case CMD_DEBUGLEVEL:
+    SerialCom::Log(DEBUG, PSTR("received set debuglevel frame"));
+    if (length != 2) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    SerialCom::SetLogLevel(payload[1]);
+    break;
+  case CMD_MODE:
+    SerialCom::Log(DEBUG, PSTR("received set mode frame"));
+    if (length != 2) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    Controller::SetExecMode(payload[1]);
+    break;
+  case CMD_PRECISION:
+    SerialCom::Log(DEBUG, PSTR("received precision frame"));
+    if (length != 3) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    Controller::SetSpinWindow(readU16(payload + 1));
+    break;
+  case CMD_LATENCY:
+    SerialCom::Log(DEBUG, PSTR("received latency frame"));
+    if (length != 6 || payload[1] > DEVICE_NUMBERS - 1) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
     }
-    // add new actions to droplet
-    Controller::AddTask(deviceMapping[deviceNumber], offset, duration);
-    // read next time
-    token = strtok(NULL, FIELD_SEPARATOR);
+    Controller::SetLatency(payload[1], readU16(payload + 2), readU16(payload + 4));
+    break;
+  case CMD_TRIGGER:
+    SerialCom::Log(DEBUG, PSTR("received trigger frame"));
+    if (length != 3) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    Controller::SetTrigger(payload[1], payload[2]);
+    break;
+  case CMD_CAPTURE:
+    SerialCom::Log(DEBUG, PSTR("received capture frame"));
+    if (length != 4) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    Controller::SetCapture(payload[1], payload[2], payload[3]);
+    break;
+  case CMD_STATS:
+    SerialCom::Log(DEBUG, PSTR("received stats frame"));
+    if (length != 6 || payload[5] > DEADLINE_ABORT) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    Stats::SetDeadline(readU32(payload + 1), payload[5]);
+    Stats::Info();
+    break;
+  case CMD_SLOT:
+    SerialCom::Log(DEBUG, PSTR("received slot frame"));
+    if (length != 3) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    processSlotCommand(payload[1], payload[2]);
+    break;
+  case CMD_WINDOW:
+    SerialCom::Log(DEBUG, PSTR("received window frame"));
+    processWindowCommand();
+    break;
+  default:
+    SerialCom::Log(WARN, PSTR("Command not found"));
+    nakCode = NAK_FORMAT;
+  }
+}
+
+
+// parse set frame - integrity is already verified by the frame CRC
+// DeviceNumber(u8) DeviceType(char) Count(u8) [Offset(u32) Duration(u32)]*Count
+// or with sweep steps [Offset(u32) Duration(u32) OffsetStep(i32) DurationStep(i32)]*Count
+void Command::processSetFrame(const unsigned char* payload, const unsigned char length) {
+  if (length < 3) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  unsigned char taskSize = 8;
+  if (length == 3 + payload[2] * 16 && payload[2] > 0) {
+    taskSize = 16;
+  } else if (length != 3 + payload[2] * 8) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  unsigned char deviceNumber = payload[0];
+  if (deviceNumber > DEVICE_NUMBERS - 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong device number"));
+    return;
+  }
+  // a refused task discards the whole frame
+  unsigned char mark = Controller::GetTaskCount();
+  for (unsigned char i = 0; i < payload[2]; i++) {
+    const unsigned char* task = payload + 3 + i * taskSize;
+    unsigned long duration = readU32(task + 4);
+    long offsetStep = taskSize == 16 ? (long)readU32(task + 8) : 0;
+    long durationStep = taskSize == 16 ? (long)readU32(task + 12) : 0;
+    if (!Controller::AddTask(deviceNumber, readU32(task), duration > 0 ? duration : MIN_DURATION, offsetStep,
+                             durationStep)) {
+      Controller::RevertTasks(mark);
+      SerialCom::Log(ERROR, PSTR("Set frame discarded"));
+      return;
+    }
+  }
+  SerialCom::Log(DEBUG, PSTR("Transmission completed and CRC verified!"));
+}
+
+
+// read little endian 16 bit field
+unsigned short Command::readU16(const unsigned char* data) {
+  return (unsigned short)data[0] | ((unsigned short)data[1] << 8);
+}
+
+
+// read little endian 32 bit field
+unsigned long Command::readU32(const unsigned char* data) {
+  return (unsigned long)data[0] | ((unsigned long)data[1] << 8) | ((unsigned long)data[2] << 16) | ((unsigned long)data[3] << 24);
+}
+
+
+// verify set or batch set command - tasks have been added while parsing
+// DeviceNumber;DeviceType;StartTime|Duration[|OffsetStep|DurationStep][;...]*[/DeviceNumber;...]*^Checksum
+void Command::processSetCommand() {
+  // checksum is mandatory, value holds it after the separator
+  if (fieldIdx < 3 || !hasValue) {
+    fail(PSTR("Wrong Format"));
+    return;
   }
   // verify checksum
-  if(chksum != chksumInternal) {
-    SerialCom::Log(ERROR, "Wrong checksum");
+  if (value != chksumInternal) {
+    nakCode = NAK_CHECKSUM;
+    fail(PSTR("Wrong checksum"));
     return;
   }
-  SerialCom::Log(DEBUG, "Transmission completed and checksum verified!");
+  SerialCom::Log(DEBUG, PSTR("Transmission completed and checksum verified!"));
 }
 
 
 // call reset of all tasks and memory cleaning
 void Command::processResetCommand() {
-  SerialCom::Log(INFO, ("Free memory: " + (String)freeMemory()).c_str());;
-  SerialCom::Log(MINLEVEL, "Deleting Tasks....");
+  SerialCom::Log(INFO, PSTR("Free memory: %u"), freeMemory());
+  SerialCom::Log(MINLEVEL, PSTR("Deleting Tasks...."));
   Controller::DeleteTasks();
-  SerialCom::Log(INFO, ("Free memory: " + (String)freeMemory()).c_str());
+  SerialCom::Log(INFO, PSTR("Free memory: %u"), freeMemory());
 }
 
 
 // parse run rommand
 // [;NumberOfRounds[;PauseTime]]
 void Command::processRunCommand() {  
-
   unsigned char rounds = 1;
   unsigned long roundDelay = 0; // ms
   
   // get additional arguments if available
-  sscanf(strtok(NULL, "\n"), "%hhu;%lu", &rounds, &roundDelay);
-  SerialCom::Log(DEBUG, ("rounds: " + (String)rounds + ", delay: " + (String)roundDelay).c_str());
+  if (argCount > 0) {
+    if (args[0] > 255) {
+      SerialCom::Log(ERROR, PSTR("Wrong Format"));
+      return;
+    }
+    rounds = args[0];
+  }
+  if (argCount > 1) {
+    roundDelay = args[1];
+  }
+  SerialCom::Log(DEBUG, PSTR("rounds: %u, delay: %lu"), rounds, roundDelay);
   Controller::ReqRun(rounds, roundDelay);
 }
 
@@ -165,8 +758,12 @@ void Command::processCancelCommand() {
 
 // show infos
 void Command::processInfoCommand() {  
-  SerialCom::Log(MINLEVEL, "Current device setup:");
-  SerialCom::Log(MINLEVEL, ("Free memory: " + (String)freeMemory()).c_str()); 
+  SerialCom::Log(MINLEVEL, PSTR("Current device setup:"));
+  SerialCom::Log(MINLEVEL, PSTR("Free memory: %u"), freeMemory());
+  SerialCom::Log(MINLEVEL, PSTR("Min free memory: %u"), minFreeMemory());
+  SerialCom::Log(MINLEVEL, PSTR("RX overflows: %u"), SerialCom::GetRxOverflows());
+  SerialCom::Log(MINLEVEL, PSTR("Log messages dropped: %u"), SerialCom::GetTxDropped());
+  Stats::Summary();
   Controller::TaskInfo();
 }
 
@@ -174,28 +771,169 @@ void Command::processInfoCommand() {
 // parse static on/off command
 // DeviceNumber -> On/Off is already specified
 void Command::processHighLowCommand(unsigned char mode) {
-  unsigned char deviceNumber;
-  // read device infos
-  if(sscanf(strtok(NULL, "\n"), "%hhu", &deviceNumber) < 1) {
-    SerialCom::Log(ERROR, "Wrong Format");
+  if (argCount < 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
     return;
   }
   // check device number bounds
-  if(deviceNumber < 1 || deviceNumber > DEVICE_NUMBERS) {
-    SerialCom::Log(WARN, "wrong device number");
+  if (args[0] > DEVICE_NUMBERS - 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong device number"));
     return;
   }
-  Controller::ReqSwitch(deviceMapping[deviceNumber], mode);
+  Controller::ReqSwitch(args[0], mode);
 }
 
 
 // set Level of debug-information
 // 0->3 (Info->Debug)
 void Command::processDebugLvlCommand() {
-  unsigned char dbgLevel;
-  if(sscanf(strtok(NULL, "\n"), "%hhu", &dbgLevel) < 1) {
-    SerialCom::Log(ERROR, "Wrong Format");
+  if (argCount < 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  SerialCom::SetLogLevel(args[0] > MAXLEVEL ? MAXLEVEL : args[0]);
+}
+
+
+// set execution mode
+// 0 -> polled main loop, 1 -> Timer1 interrupt
+void Command::processModeCommand() {
+  if (argCount < 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  Controller::SetExecMode(args[0]);
+}
+
+
+// switch edge timing trace or dump it
+// [;0|1] -> without argument the trace is dumped
+void Command::processTraceCommand() {
+  if (argCount > 0) {
+    Trace::Enable(args[0] != 0);
+    return;
+  }
+  if (Controller::IsRunning()) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  Trace::Dump();
+}
+
+
+// set the precision window or report its accuracy
+// [;Window] -> without argument the accuracy is reported
+void Command::processPrecisionCommand() {
+  if (argCount > 0) {
+    Controller::SetSpinWindow(args[0]);
+    return;
+  }
+  HwTimer::SpinInfo();
+}
+
+
+// set or report the latency of devices
+// [;DeviceNumber[;OnLag;OffLag]] -> without lags they are reported, without device for all devices
+void Command::processLatencyCommand() {
+  if (argCount == 0) {
+    Controller::LatencyInfo(DEVICE_NUMBERS);
+    return;
+  }
+  if (args[0] > DEVICE_NUMBERS - 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong device number"));
+    return;
+  }
+  if (argCount == 1) {
+    Controller::LatencyInfo(args[0]);
+    return;
+  }
+  if (argCount != 3 || args[1] > MAX_LATENCY || args[2] > MAX_LATENCY) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  Controller::SetLatency(args[0], args[1], args[2]);
+}
+
+
+// set or report the hardware trigger
+// [;Mode[;Edge]] -> without argument the setting is reported, edge 0 falling (default) or 1 rising
+void Command::processTriggerCommand() {
+  if (argCount == 0) {
+    Controller::TriggerInfo();
+    return;
+  }
+  if (argCount > 2 || args[0] > TRIGGER_FREERUN || (argCount == 2 && args[1] > 1)) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  Controller::SetTrigger(args[0], argCount == 2 ? args[1] : 0);
+}
+
+
+// set or report the input capture
+// [;Mode[;DeviceNumber[;Edge]]] -> without argument the deltas are reported, edge 0 falling (default) or 1 rising
+void Command::processCaptureCommand() {
+  if (argCount == 0) {
+    Capture::Info();
+    return;
+  }
+  if (argCount > 3 || args[0] > CAPTURE_FEEDBACK || (args[0] != CAPTURE_OFF && argCount < 2)
+      || (argCount > 1 && args[1] > DEVICE_NUMBERS - 1) || (argCount == 3 && args[2] > 1)) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
     return;
   }
-  SerialCom::SetLogLevel(dbgLevel);
+  Controller::SetCapture(args[0], argCount > 1 ? args[1] : 0, argCount == 3 ? args[2] : 0);
+}
+
+
+// report or reset the loop statistics, set the deadline of edges
+// [;Switch[;Deadline[;Policy]]] -> without argument they are reported, 0 resets them,
+// 1 sets the deadline in us and the policy, which resets them too
+void Command::processStatsCommand() {
+  if (argCount == 0) {
+    Stats::Info();
+    return;
+  }
+  if (args[0] == 0 && argCount == 1) {
+    Stats::Reset();
+    SerialCom::Log(INFO, PSTR("Statistics cleared"));
+    return;
+  }
+  if (args[0] != 1 || argCount < 2 || argCount > 3 || (argCount == 3 && args[2] > DEADLINE_ABORT)) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  Stats::SetDeadline(args[1], argCount == 3 ? args[2] : DEADLINE_COUNT);
+  Stats::Info();
+}
+
+
+// report the window of sequenced commands: W:Commands:Bytes
+// the host may have that many commands and bytes sent but not yet acknowledged
+void Command::processWindowCommand() {
+  SerialCom::Log(MINLEVEL, PSTR("W:%u:%u"), SEQ_WINDOW, RX_BUFFER_SIZE - 1);
+}
+
+
+// store, load or check a schedule slot
+// Operation;SlotNumber - operation S, L or C
+void Command::processSlotCommand(const unsigned char op, const unsigned long slot) {
+  if (slot > EEPROM_SLOTS - 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong slot number"));
+    return;
+  }
+  switch (op)
+  {
+  case SLOT_STORE:
+    Controller::SaveSlot(slot);
+    break;
+  case SLOT_LOAD:
+    Controller::LoadSlot(slot);
+    break;
+  case SLOT_CHECK:
+    Controller::SlotInfo(slot);
+    break;
+  default:
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+  }
 }
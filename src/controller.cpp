@@ -28,6 +28,15 @@
 #include "ardudrop.h"
 #include "utils.h"
 #include "serialcom.h"
+#include "hwtimer.h"
+#include "trace.h"
+#include "storage.h"
+#include "sequence.h"
+#include "capture.h"
+#include "stats.h"
+
+
+static_assert(2 * MAX_TASKS <= 255, "edges of the task table are counted in a byte");
 
 
 // init static members
@@ -35,12 +44,38 @@ bool Controller::initDone = false;
 bool Controller::taskRunning = false;
 bool Controller::taskStart = false;
 bool Controller::taskCancel = false;
+unsigned char Controller::execMode = DEFAULT_EXEC_MODE;
+unsigned char Controller::triggerMode = TRIGGER_OFF;
+unsigned char Controller::triggerEdge = 0;
+volatile bool Controller::armed = false;
+volatile bool Controller::triggered = false;
+volatile unsigned long Controller::triggerTime = 0;
 unsigned char Controller::loopState = 0;
 unsigned char Controller::roundsToGo = 0;
+unsigned char Controller::roundCount = 0;
 unsigned long Controller::timeStart = 0;
 unsigned long Controller::roundDelay = 0;
-Action* Controller::firstAction = NULL;
-Action* Controller::currentAction = NULL;
+Task Controller::tasks[MAX_TASKS];
+unsigned char Controller::taskCount = 0;
+TaskSteps Controller::steps[MAX_SWEEPS];
+unsigned char Controller::stepCount = 0;
+Task Controller::activeTasks[MAX_TASKS];
+unsigned char Controller::activeTaskCount = 0;
+TaskSteps Controller::activeSteps[MAX_SWEEPS];
+unsigned char Controller::activeStepCount = 0;
+Action Controller::nextAction;
+unsigned short Controller::readPos = 0;
+bool Controller::actionPending = false;
+bool Controller::staged = false;
+bool Controller::commitPending = false;
+bool Controller::sweeping = false;
+unsigned long Controller::lead = 0;
+unsigned char Controller::overlaps = 0;
+unsigned short Controller::onLags[DEVICE_NUMBERS];
+unsigned short Controller::offLags[DEVICE_NUMBERS];
+bool Controller::lagsChanged = false;
+unsigned long Controller::captureTarget = 0;
+bool Controller::captureFound = false;
 
 
 /*
@@ -52,9 +87,14 @@ void Controller::Setup() {
   }
   // setup pins as output
   for(int i = 0; i < DEVICE_NUMBERS; i++) {
-    pinMode(deviceMapping[i], OUTPUT);
+    pinMode(devicePins[i].Pin, OUTPUT);
     // manually set pin to LOW as some boards default to HIGH
-    digitalWrite(deviceMapping[i], LOW);
+    digitalWrite(devicePins[i].Pin, LOW);
+  }
+  HwTimer::Setup();
+  if (!Storage::LoadLatency(onLags, offLags)) {
+    memset(onLags, 0, sizeof(onLags));
+    memset(offLags, 0, sizeof(offLags));
   }
   initDone = true;
 }
@@ -71,8 +111,9 @@ void Controller::Loop(){
   switch (loopState)
   {
   case CTRL_STANDBY:
-    if (taskStart && (firstAction != NULL)) {
-      SerialCom::Log(INFO, "Task started...");
+    Capture::Report();
+    if (taskStart && (Sequence::GetCount() > 0)) {
+      SerialCom::Log(INFO, PSTR("Task started..."));
       loopState = CTRL_TASKBEGIN;
       taskRunning = true;
       taskStart = false;
@@ -83,26 +124,92 @@ void Controller::Loop(){
       loopState = CTRL_CANCEL;
       return;
     }
+    Measure();
     if (roundsToGo <= 0) {
       loopState = CTRL_STANDBY;
       return;
     }
-    SerialCom::Log(INFO, ("rounds to go: " + (String)roundsToGo).c_str());
+    // compile a schedule committed during the last round and move swept
+    // tasks to their offsets of this round
+    if (commitPending || sweeping || lagsChanged) {
+      lagsChanged = false;
+      if (!Compile(roundCount)) {
+        loopState = CTRL_CANCEL;
+        return;
+      }
+      if (commitPending) {
+        commitPending = false;
+        SerialCom::Log(INFO, PSTR("staged schedule activated"));
+        if (overlaps > 0) {
+          SerialCom::Log(WARN, PSTR("%u overlapping pulses merged"), overlaps);
+        }
+      }
+    }
+    Target();
+    SerialCom::Log(INFO, PSTR("rounds to go: %u"), roundsToGo);
     roundsToGo--;
+    roundCount++;
+    Trace::BeginRound(roundCount);
+    Stats::BeginRound();
+    if (triggerMode == TRIGGER_REARM || (triggerMode == TRIGGER_FREERUN && roundCount == 1)) {
+      // the round is started by the trigger interrupt
+      ArmTrigger();
+      loopState = CTRL_ARMED;
+      return;
+    }
     timeStart = micros();
-    currentAction = firstAction;
+    StartTimer();
+    if (execMode == EXEC_POLLED) {
+      Rewind();
+    }
     loopState = CTRL_TASK;
     break;
+  case CTRL_ARMED:
+    Capture::Report();
+    if (taskCancel) {
+      loopState = CTRL_CANCEL;
+      return;
+    }
+    if (triggered) {
+      // the timer is already running, polled rounds count from the trigger
+      timeStart = triggerTime;
+      if (execMode == EXEC_POLLED) {
+        Rewind();
+      }
+      Trace::Trigger(triggerTime);
+      SerialCom::Log(INFO, PSTR("round %u triggered at %lu"), roundCount, triggerTime);
+      loopState = CTRL_TASK;
+    }
+    break;
   case CTRL_TASK:
     if (taskCancel) {
       loopState = CTRL_CANCEL;
       return;
     }
-    if (currentAction->Offset <= GetDeltaT(timeStart)) {
-      digitalWrite(currentAction->Pin, currentAction->Mode);
-      if (currentAction->Next != NULL) {
-        currentAction = currentAction->Next;
-      } else {
+    if (Stats::RoundMissed() && Stats::GetPolicy() == DEADLINE_ABORT) {
+      SerialCom::Log(ERROR, PSTR("round %u missed the deadline - aborted"), roundCount);
+      Stats::BadRound();
+      loopState = CTRL_CANCEL;
+      return;
+    }
+    if (execMode == EXEC_TIMER) {
+      // actions are fired from the timer interrupt
+      if (HwTimer::IsDone()) {
+        loopState = CTRL_PAUSEBEGIN;
+      }
+    } else {
+      unsigned long deltaT = GetDeltaT(timeStart);
+      // fire every port write that is due - one write per port and offset
+      while (actionPending && nextAction.Offset <= deltaT) {
+        Fire(nextAction);
+        Stats::Edge(deltaT - nextAction.Offset);
+        if (Trace::IsEnabled()) {
+          Trace::Record(nextAction.Offset, GetDeltaT(timeStart), nextAction.Port, nextAction.SetMask,
+            nextAction.ClearMask);
+        }
+        actionPending = Sequence::Read(readPos, nextAction);
+      }
+      if (!actionPending) {
         loopState = CTRL_PAUSEBEGIN;
       }
     }
@@ -112,18 +219,25 @@ void Controller::Loop(){
       loopState = CTRL_CANCEL;
       return;
     }
+    if (Stats::RoundMissed() && Stats::GetPolicy() == DEADLINE_MARK) {
+      SerialCom::Log(WARN, PSTR("round %u missed the deadline"), roundCount);
+      Stats::BadRound();
+    }
     if (roundsToGo <= 0) {
+      Measure();
+      HwTimer::Stop();
       taskRunning = false;
       roundsToGo = 0;
       roundDelay = 0;
       loopState = CTRL_STANDBY;
-      SerialCom::Log(INFO, "Task finished");
+      SerialCom::Log(INFO, PSTR("Task finished"));
       return;
     }
     timeStart = micros();
     loopState = CTRL_PAUSE;
     break;
   case CTRL_PAUSE:
+    Capture::Report();
     if (taskCancel) {
       loopState = CTRL_CANCEL;
       return;
@@ -131,16 +245,20 @@ void Controller::Loop(){
     if (roundDelay <= GetDeltaT(timeStart)) { loopState = CTRL_TASKBEGIN; }
     break;  
   case CTRL_CANCEL:
-    // set all pins to LOW and enter standby
+    armed = false;
+    HwTimer::Stop();
+    // set all pins to LOW and enter standby - inputs keep their pull-up
     for(int i = 0; i < DEVICE_NUMBERS; i++) {
-      digitalWrite(deviceMapping[i], LOW);
+      if (!IsInput(i)) {
+        Switch(i, LOW);
+      }
     }
     taskCancel = false;
     taskRunning = false;
     roundsToGo = 0;
     roundDelay = 0;
     loopState = CTRL_STANDBY;
-    SerialCom::Log(INFO, "Task canceled");
+    SerialCom::Log(INFO, PSTR("Task canceled"));
     break;  
   default:
     loopState = CTRL_STANDBY;
@@ -150,105 +268,425 @@ void Controller::Loop(){
 
 
 /*
- * Add two actions to memory.
- *    HIGH action at offset
- *    LOW action at offset + duration.
+ * Start decoding the sequence for a polled round
  */
-void Controller::AddTask(const unsigned char targetPin, const unsigned long offset, const unsigned long duration) {
-  // abort if tasks are currently running
-  if (taskRunning) {
-    SerialCom::Log(INFO, "denied - tasks are currently running");
-    return;
+void Controller::Rewind() {
+  readPos = 0;
+  nextAction.Offset = 0;
+  actionPending = Sequence::Read(readPos, nextAction);
+}
+
+
+/*
+ * Start Timer1 for the round - it plays the sequence or only counts
+ * as time base of the input capture
+ */
+void Controller::StartTimer() {
+  if (execMode == EXEC_TIMER) {
+    HwTimer::Start();
+  } else if (Capture::IsEnabled()) {
+    HwTimer::StartClock();
   }
-  // check if enough momory is available
-  if (freeMemory() < 2 * sizeof(struct Action)) {
-    SerialCom::Log(ERROR, "not enough memory available");
+  Capture::Arm();
+}
+
+
+/*
+ * Offset of the first pulse of the capture device in the round about to
+ * be played - kept as the active table may be replaced during the round
+ */
+void Controller::Target() {
+  captureFound = false;
+  if (!Capture::IsEnabled()) {
     return;
   }
-  // opening action
-  Action *actionOn = (Action*) malloc(sizeof(struct Action));
-  actionOn->Offset = offset;
-  actionOn->Mode = HIGH;
-  actionOn->Pin = targetPin;
-  actionOn->Next = NULL;
-  AddAction(actionOn);
-  // closing action
-  Action *actionOff = (Action*) malloc(sizeof(struct Action));
-  actionOff->Offset = offset + duration;
-  actionOff->Mode = LOW;
-  actionOff->Pin = targetPin;
-  actionOff->Next = NULL;
-  AddAction(actionOff);
+  unsigned char device = Capture::GetDevice();
+  for (unsigned char i = 0; i < activeTaskCount; i++) {
+    if (activeTasks[i].Device != device) {
+      continue;
+    }
+    unsigned long offset = Sweep(activeTasks[i].Offset, StepsOf(activeTasks[i]).OffsetStep, roundCount);
+    if (!captureFound || offset < captureTarget) {
+      captureTarget = offset;
+      captureFound = true;
+    }
+  }
+  captureTarget += lead;
 }
 
 
 /*
- * Add a new action to droplet
- * Actions are sorted by their offset in ascending order
+ * Compare the captured event of the round just played with the commanded
+ * offset of the device - with feedback half of the error moves its on lag
  */
-void Controller::AddAction(Action *newAction) {
-  // abort if tasks are currently running
-  if (taskRunning) {
-    SerialCom::Log(ERROR, "denied - tasks are currently running");
+void Controller::Measure() {
+  if (!Capture::IsEnabled() || roundCount == 0) {
     return;
   }
-  Action *action = firstAction;
-  // first action
-  if(action == NULL) {
-    firstAction = newAction;
+  unsigned char device = Capture::GetDevice();
+  long delta;
+  if (!captureFound || !Capture::Evaluate(roundCount, captureTarget, delta)) {
     return;
   }
-  // add action at first position
-  if(firstAction->Offset > newAction->Offset) {
-    firstAction = newAction;
-    newAction->Next = action;
+  if (Capture::GetMode() == CAPTURE_FEEDBACK && delta / 2 != 0) {
+    long lag = (long)onLags[device] + delta / 2;
+    if (lag < 0) {
+      lag = 0;
+    } else if (lag > MAX_LATENCY) {
+      lag = MAX_LATENCY;
+    }
+    onLags[device] = lag;
+    lagsChanged = true;
+  }
+}
+
+
+/*
+ * Wait for the trigger interrupt - earlier triggers are ignored
+ */
+void Controller::ArmTrigger() {
+  unsigned char oldSREG = SREG;
+  cli();
+  triggered = false;
+  armed = true;
+  SREG = oldSREG;
+  SerialCom::Log(INFO, PSTR("armed - waiting for trigger"));
+}
+
+
+/*
+ * Trigger interrupt - starts the armed round
+ * Timer1 is started first so the latency to the first edge stays fixed
+ */
+void Controller::OnTrigger() {
+  if (!armed) {
     return;
   }
-  // go to correct position
-  while(action->Next != NULL && action->Next->Offset <= newAction->Offset) {
-    action = action->Next;
+  armed = false;
+  StartTimer();
+  triggerTime = micros();
+  triggered = true;
+}
+
+
+/*
+ * Add a task to the staging schedule table.
+ * The table is committed and compiled into sorted actions when a run is
+ * requested or - while running - on commit at the next round boundary.
+ * false if the task is refused
+ */
+bool Controller::AddTask(const unsigned char device, const unsigned long offset, const unsigned long duration,
+                         const long offsetStep, const long durationStep) {
+  // check if there is room left in the schedule table
+  if (taskCount >= MAX_TASKS) {
+    SerialCom::Log(ERROR, PSTR("schedule table full"));
+    return false;
+  }
+  if (IsInput(device)) {
+    SerialCom::Log(ERROR, PSTR("denied - device %u is an input"), device);
+    return false;
+  }
+  tasks[taskCount].Steps = NO_STEPS;
+  if (offsetStep != 0 || durationStep != 0) {
+    if (stepCount >= MAX_SWEEPS) {
+      SerialCom::Log(ERROR, PSTR("sweep table full"));
+      return false;
+    }
+    steps[stepCount].OffsetStep = offsetStep;
+    steps[stepCount].DurationStep = durationStep;
+    tasks[taskCount].Steps = stepCount++;
+  }
+  tasks[taskCount].Offset = offset;
+  tasks[taskCount].Duration = duration;
+  tasks[taskCount].Device = device;
+  taskCount++;
+  staged = true;
+  return true;
+}
+
+
+/*
+ * Make the staging table the active schedule and compile it
+ * only called while idle - false if it does not fit
+ */
+bool Controller::Commit() {
+  Activate();
+  bool compiled = Compile(0);
+  if (overlaps > 0) {
+    SerialCom::Log(WARN, PSTR("%u overlapping pulses merged"), overlaps);
+  }
+  commitPending = false;
+  return compiled;
+}
+
+
+/*
+ * Copy the staging table into the active one - the sequence of a running
+ * round is not touched, it is compiled from the copy at the next round
+ */
+void Controller::Activate() {
+  for (unsigned char i = 0; i < taskCount; i++) {
+    activeTasks[i] = tasks[i];
+  }
+  activeTaskCount = taskCount;
+  for (unsigned char i = 0; i < stepCount; i++) {
+    activeSteps[i] = steps[i];
+  }
+  activeStepCount = stepCount;
+  sweeping = activeStepCount > 0;
+  staged = false;
+}
+
+
+/*
+ * Compile task table into packed actions for a round of a run
+ *    HIGH edge at offset
+ *    LOW edge at offset + duration.
+ * Offset and duration are moved by round times their steps.
+ * Edges are moved earlier by the on or off lag of their device. If an
+ * edge would have to fire before the round starts, the whole round is
+ * delayed by the lead it needs, so all devices keep their relative timing.
+ * Edges are sorted by offset and port, then walked once: overlapping or
+ * adjacent pulses of one pin are merged into one and all edges of one port
+ * sharing an offset become a single set/clear mask pair.
+ * A schedule that does not fit the sequence is dropped completely, it is
+ * never played in part - false in that case.
+ */
+bool Controller::Compile(const unsigned char round) {
+  // lead needed by the device lagging most behind its offset
+  lead = 0;
+  for (unsigned char i = 0; i < activeTaskCount; i++) {
+    const Task &task = activeTasks[i];
+    if (IsInput(task.Device)) {
+      continue;
+    }
+    unsigned long offset = Sweep(task.Offset, StepsOf(task).OffsetStep, round);
+    if (onLags[task.Device] > offset + lead) {
+      lead = onLags[task.Device] - offset;
+    }
+  }
+  // the edges only live on the stack while compiling
+  TaskEdge edges[2 * MAX_TASKS];
+  unsigned char edgeCount = 0;
+  for (unsigned char i = 0; i < activeTaskCount; i++) {
+    // tasks stored or staged before the pin became an input are left out
+    if (IsInput(activeTasks[i].Device)) {
+      continue;
+    }
+    unsigned long setAt, clearAt;
+    Edges(activeTasks[i], round, setAt, clearAt);
+    edges[edgeCount].Offset = setAt;
+    edges[edgeCount].Task = i;
+    edges[edgeCount].Set = true;
+    edgeCount++;
+    edges[edgeCount].Offset = clearAt;
+    edges[edgeCount].Task = i;
+    edges[edgeCount].Set = false;
+    edgeCount++;
+  }
+  // stable insertion sort - tasks are mostly added in time order
+  for (unsigned char i = 1; i < edgeCount; i++) {
+    TaskEdge edge = edges[i];
+    unsigned char j = i;
+    while (j > 0 && edgeBefore(edge, edges[j - 1])) {
+      edges[j] = edges[j - 1];
+      j--;
+    }
+    edges[j] = edge;
+  }
+  // pulses of each device open at the current edge
+  unsigned char depth[DEVICE_NUMBERS];
+  memset(depth, 0, sizeof(depth));
+  overlaps = 0;
+  Sequence::Clear();
+  Action action;
+  action.Offset = 0;
+  action.Port = 0;
+  action.SetMask = 0;
+  action.ClearMask = 0;
+  for (unsigned char i = 0; i < edgeCount; i++) {
+    const TaskEdge &edge = edges[i];
+    const DevicePin &pin = devicePins[activeTasks[edge.Task].Device];
+    if (edge.Offset != action.Offset || pin.Port != action.Port) {
+      if (!append(action)) {
+        return false;
+      }
+      action.Offset = edge.Offset;
+      action.Port = pin.Port;
+      action.SetMask = 0;
+      action.ClearMask = 0;
+    }
+    unsigned char &open = depth[activeTasks[edge.Task].Device];
+    if (edge.Set) {
+      // a pulse starting inside another one is merged into it
+      if (open++ > 0) {
+        overlaps++;
+      } else if (action.ClearMask & pin.Mask) {
+        // adjacent to the pulse just ended - the pin stays HIGH
+        action.ClearMask &= ~pin.Mask;
+      } else {
+        action.SetMask |= pin.Mask;
+      }
+    } else if (--open == 0) {
+      action.ClearMask |= pin.Mask;
+    }
+  }
+  return append(action);
+}
+
+
+/*
+ * Order of edges in the sequence - by offset, then port, a clear before a
+ * set on the same offset so adjacent pulses of a pin can be merged
+ */
+bool Controller::edgeBefore(const TaskEdge &edge, const TaskEdge &other) {
+  if (edge.Offset != other.Offset) {
+    return edge.Offset < other.Offset;
+  }
+  unsigned char port = devicePins[activeTasks[edge.Task].Device].Port;
+  unsigned char otherPort = devicePins[activeTasks[other.Task].Device].Port;
+  if (port != otherPort) {
+    return port < otherPort;
+  }
+  return !edge.Set && other.Set;
+}
+
+
+/*
+ * Add a compiled action to the sequence - actions without a mask are skipped
+ * a full sequence is dropped completely
+ */
+bool Controller::append(const Action &action) {
+  if (action.SetMask == 0 && action.ClearMask == 0) {
+    return true;
+  }
+  if (!Sequence::Append(action)) {
+    Sequence::Clear();
+    SerialCom::Log(ERROR, PSTR("schedule too long - more than %u bytes at %lu"), SEQUENCE_SIZE, action.Offset);
+    return false;
+  }
+  return true;
+}
+
+
+/*
+ * Edges of a task in a round - moved by its sweep steps and device lags
+ */
+void Controller::Edges(const Task &task, const unsigned char round, unsigned long &setAt, unsigned long &clearAt) {
+  const TaskSteps &taskSteps = StepsOf(task);
+  unsigned long offset = Sweep(task.Offset, taskSteps.OffsetStep, round);
+  unsigned long duration = Sweep(task.Duration, taskSteps.DurationStep, round);
+  if (duration == 0) {
+    duration = 1;
+  }
+  setAt = offset + lead - onLags[task.Device];
+  clearAt = offset + duration + lead;
+  // a pulse shorter than the off lag still has to end after it started
+  if (clearAt > setAt + offLags[task.Device]) {
+    clearAt -= offLags[task.Device];
+  } else {
+    clearAt = setAt + 1;
+  }
+}
+
+
+/*
+ * Value of a swept field in a round - clamped at zero
+ */
+unsigned long Controller::Sweep(const unsigned long base, const long step, const unsigned char round) {
+  if (step == 0 || round == 0) {
+    return base;
+  }
+  long delta = step * round;
+  if (delta < 0 && (unsigned long)-delta > base) {
+    return 0;
   }
-  // insert at new position
-  newAction->Next = action->Next;
-  action->Next = newAction;
+  return base + delta;
+}
+
+
+/*
+ * Sweep steps of an active task - zero steps if it does not sweep
+ */
+const TaskSteps &Controller::StepsOf(const Task &task) {
+  static const TaskSteps none = {0, 0};
+  return task.Steps == NO_STEPS ? none : activeSteps[task.Steps];
+}
+
+
+/*
+ * Apply one compiled action with a single write to its port register
+ */
+void Controller::Fire(const Action &action) {
+  volatile unsigned char *out = portOutputRegister(action.Port);
+  unsigned char oldSREG = SREG;
+  cli();
+  *out = (*out & ~action.ClearMask) | action.SetMask;
+  SREG = oldSREG;
 }
 
 
 /* 
- * Removes all actions from droplet and releases their memory
+ * Removes all tasks from staging schedule table
  */
 void Controller::DeleteTasks() {
-  // abort if tasks are currently running
-  if (taskRunning) {
-    SerialCom::Log(ERROR, "denied - tasks are currently running");
+  taskCount = 0;
+  stepCount = 0;
+  staged = true;
+}
+
+
+/*
+ * Drop all tasks added after the first count tasks
+ * used to undo a rejected upload
+ */
+void Controller::RevertTasks(const unsigned char count) {
+  if (count >= taskCount) {
     return;
   }
-  Action *action = firstAction;  
-  while(action != NULL) {
-    Action *next = action->Next;
-    free(action);
-    action = next;
+  // steps are added in task order - the first dropped sweeping task owns the first dropped steps
+  for (unsigned char i = count; i < taskCount; i++) {
+    if (tasks[i].Steps != NO_STEPS) {
+      stepCount = tasks[i].Steps;
+      break;
+    }
   }
-  firstAction = NULL;
+  taskCount = count;
+  staged = true;
 }
 
 
 /*
- * display list of tasks
+ * display list of active actions
+ * while idle staged changes are committed first
  */
 void Controller::TaskInfo() {
-  // abort if tasks are currently running
-  if (taskRunning) {
-    SerialCom::Log(ERROR, "denied - tasks are currently running");
-    return;
+  if (!taskRunning && staged) {
+    Commit();
+  }
+  SerialCom::Log(MINLEVEL, PSTR("Tasks: %u of %u, sweeping: %u of %u"), activeTaskCount, MAX_TASKS, activeStepCount,
+                 MAX_SWEEPS);
+  if (staged) {
+    SerialCom::Log(MINLEVEL, PSTR("Staged tasks: %u, sweeping: %u"), taskCount, stepCount);
+  }
+  if (commitPending) {
+    SerialCom::Log(MINLEVEL, PSTR("Committed tasks: %u - active at next round"), activeTaskCount);
+  }
+  if (lead > 0) {
+    SerialCom::Log(MINLEVEL, PSTR("Latency lead: %lu"), lead);
+  }
+  if (overlaps > 0) {
+    SerialCom::Log(MINLEVEL, PSTR("Overlapping pulses merged: %u"), overlaps);
   }
-  Action *action = firstAction;
-  if(action == NULL) {
-    SerialCom::Log(MINLEVEL, "No actions defined!");
+  if (Sequence::GetCount() == 0) {
+    SerialCom::Log(MINLEVEL, PSTR("No actions defined!"));
   } else {
-    while(action != NULL) {
-      SerialCom::Log(MINLEVEL, ((String)action->Pin + ":" + (String)action->Offset + ":" + (String)action->Mode).c_str());
-      action = action->Next;
+    SerialCom::Log(MINLEVEL, PSTR("Actions: %u in %u bytes"), Sequence::GetCount(), Sequence::GetSize());
+    Action action;
+    action.Offset = 0;
+    unsigned short pos = 0;
+    while (Sequence::Read(pos, action)) {
+      SerialCom::Log(MINLEVEL, PSTR("%u:%lu:%u:%u"), action.Port, action.Offset, action.SetMask, action.ClearMask);
     }
   }
 }
@@ -259,42 +697,279 @@ void Controller::TaskInfo() {
  */
 void Controller::ReqRun(const unsigned char rounds, const unsigned long delay) {
   if (taskRunning) {
-    SerialCom::Log(WARN, "task already running...");
+    SerialCom::Log(WARN, PSTR("task already running..."));
     return;
   }
-  if (firstAction == NULL) {
-    SerialCom::Log(WARN, "no task defined...");
+  if (staged) {
+    Commit();
+  }
+  if (activeTaskCount == 0) {
+    SerialCom::Log(WARN, PSTR("no task defined..."));
+    return;
+  }
+  if (Sequence::GetCount() == 0) {
+    SerialCom::Log(ERROR, PSTR("denied - schedule not compiled"));
     return;
   }
   roundsToGo = rounds;
+  roundCount = 0;
+  Capture::Clear();
   roundDelay = delay;
   taskStart = true;
 }
 
 
+/*
+ * Request activation of the staging schedule
+ * immediately while idle, at the next round boundary while running -
+ * later edits of the staging table do not change a pending commit
+ */
+void Controller::ReqCommit() {
+  if (!taskRunning) {
+    Commit();
+    SerialCom::Log(INFO, PSTR("staged schedule activated"));
+    return;
+  }
+  Activate();
+  commitPending = true;
+  SerialCom::Log(INFO, PSTR("staged schedule activated at next round"));
+}
+
+
 /*
  * Request cancellation tasks
  */
 void Controller::ReqCancel() {
   if (taskRunning) {
     taskCancel = true;
-    SerialCom::Log(INFO, "aborting Task requested");
+    SerialCom::Log(INFO, PSTR("aborting Task requested"));
+  } else {
+    SerialCom::Log(INFO, PSTR("No tasks to cancel"));
+  }
+}
+
+
+/*
+ * Request static switch of a device
+ * only allowed if no task running
+ */
+void Controller::ReqSwitch(const unsigned char device, const unsigned char mode) {
+  if (taskRunning) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  if (IsInput(device)) {
+    SerialCom::Log(ERROR, PSTR("denied - device %u is an input"), device);
+    return;
+  }
+  Switch(device, mode);
+}
+
+
+/*
+ * Check if the pin of a device is used as an input - it must not be driven
+ * as that would toggle its pull-up
+ */
+bool Controller::IsInput(const unsigned char device) {
+  unsigned char pin = devicePins[device].Pin;
+  return (triggerMode != TRIGGER_OFF && pin == TRIGGER_PIN) || (Capture::IsEnabled() && pin == CAPTURE_PIN);
+}
+
+
+/*
+ * Drive the output of a device HIGH or LOW with a single port write
+ */
+void Controller::Switch(const unsigned char device, const unsigned char mode) {
+  Action action;
+  action.Offset = 0;
+  action.Port = devicePins[device].Port;
+  action.SetMask = mode == LOW ? 0 : devicePins[device].Mask;
+  action.ClearMask = mode == LOW ? devicePins[device].Mask : 0;
+  Fire(action);
+}
+
+
+/*
+ * Select how the schedule is played
+ *    EXEC_POLLED - compared against micros() in the main loop
+ *    EXEC_TIMER  - fired from the Timer1 compare interrupt
+ * only allowed if no task running
+ */
+void Controller::SetExecMode(const unsigned char mode) {
+  if (taskRunning) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  execMode = mode == EXEC_POLLED ? EXEC_POLLED : EXEC_TIMER;
+  SerialCom::Log(INFO, PSTR("Execution mode is set to %u"), execMode);
+}
+
+
+/*
+ * Set the precision window of the timer mode in us - 0 switches it off
+ * only allowed if no task running
+ */
+void Controller::SetSpinWindow(const unsigned long window) {
+  if (taskRunning) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  if (window > MAX_SPIN_WINDOW) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  HwTimer::SetSpinWindow(window);
+  SerialCom::Log(INFO, PSTR("Spin window is set to %lu"), window);
+}
+
+
+/*
+ * Select how rounds are started
+ *    TRIGGER_OFF     - right after the run command and the round delay
+ *    TRIGGER_REARM   - every round waits for a trigger on TRIGGER_PIN
+ *    TRIGGER_FREERUN - the first round waits for a trigger
+ * edge 0 triggers on a falling, 1 on a rising edge
+ * only allowed if no task running
+ */
+void Controller::SetTrigger(const unsigned char mode, const unsigned char edge) {
+  if (taskRunning) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  if (mode > TRIGGER_FREERUN) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  detachInterrupt(digitalPinToInterrupt(TRIGGER_PIN));
+  triggerMode = mode;
+  triggerEdge = edge ? 1 : 0;
+  if (mode == TRIGGER_OFF) {
+    // the pin is a device output again
+    pinMode(TRIGGER_PIN, OUTPUT);
+    digitalWrite(TRIGGER_PIN, LOW);
   } else {
-    SerialCom::Log(INFO, "No tasks to cancel");
+    pinMode(TRIGGER_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(TRIGGER_PIN), OnTrigger, triggerEdge ? RISING : FALLING);
   }
+  // leave out or bring back the tasks of the pin
+  Compile(0);
+  TriggerInfo();
 }
 
 
 /*
- * Request static switch of pins
+ * Print the trigger setting
+ */
+void Controller::TriggerInfo() {
+  SerialCom::Log(INFO, PSTR("Trigger mode: %u, edge: %u, pin: %u"), triggerMode, triggerEdge, TRIGGER_PIN);
+}
+
+
+/*
+ * Map the input capture to a device - only allowed if no task running
+ */
+void Controller::SetCapture(const unsigned char mode, const unsigned char device, const unsigned char edge) {
+  if (taskRunning) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  if (mode > CAPTURE_FEEDBACK || device > DEVICE_NUMBERS - 1) {
+    SerialCom::Log(ERROR, PSTR("Wrong Format"));
+    return;
+  }
+  Capture::SetMode(mode, device, edge);
+  // leave out or bring back the tasks of the pin
+  Compile(0);
+  Capture::Info();
+}
+
+
+/*
+ * Set the lags of a device between its pin and the physical event in us
+ * they are stored in EEPROM and applied whenever the schedule is compiled
  * only allowed if no task running
  */
-void Controller::ReqSwitch(const unsigned char targetPin, const unsigned char mode) {
+void Controller::SetLatency(const unsigned char device, const unsigned short onLag, const unsigned short offLag) {
+  if (taskRunning) {
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  onLags[device] = onLag;
+  offLags[device] = offLag;
+  Storage::SaveLatency(onLags, offLags);
+  Compile(0);
+  SerialCom::Log(INFO, PSTR("Latency of device %u is set to %u/%u"), device, onLag, offLag);
+}
+
+
+/*
+ * Report the lags of a device, of all devices with lags for DEVICE_NUMBERS
+ *    K:device:onLag:offLag
+ */
+void Controller::LatencyInfo(const unsigned char device) {
+  bool found = false;
+  for (unsigned char i = 0; i < DEVICE_NUMBERS; i++) {
+    if (i == device || (device >= DEVICE_NUMBERS && (onLags[i] > 0 || offLags[i] > 0))) {
+      SerialCom::Log(MINLEVEL, PSTR("K:%u:%u:%u"), i, onLags[i], offLags[i]);
+      found = true;
+    }
+  }
+  if (!found) {
+    SerialCom::Log(MINLEVEL, PSTR("No latencies defined!"));
+  }
+}
+
+
+/*
+ * Store the active schedule in an EEPROM slot
+ * while idle staged changes are committed first
+ */
+void Controller::SaveSlot(const unsigned char slot) {
   if (taskRunning) {
-    SerialCom::Log(ERROR, "denied - task running");
+    SerialCom::Log(ERROR, PSTR("denied - task running"));
+    return;
+  }
+  if (staged) {
+    Commit();
+  }
+  if (!Storage::Save(slot, activeTasks, activeTaskCount, activeSteps)) {
+    SerialCom::Log(ERROR, PSTR("invalid slot"));
+    return;
+  }
+  SerialCom::Log(INFO, PSTR("%u tasks stored in slot %u"), activeTaskCount, slot);
+}
+
+
+/*
+ * Replace the staging table with the tasks of an EEPROM slot and commit it
+ * a running schedule switches at the next round boundary
+ */
+void Controller::LoadSlot(const unsigned char slot) {
+  unsigned char count;
+  unsigned char sweepCount;
+  if (!Storage::Load(slot, tasks, count, steps, sweepCount)) {
+    SerialCom::Log(ERROR, PSTR("slot %u empty, corrupted or stored on another board"), slot);
+    return;
+  }
+  taskCount = count;
+  stepCount = sweepCount;
+  staged = true;
+  SerialCom::Log(INFO, PSTR("%u tasks loaded from slot %u"), count, slot);
+  ReqCommit();
+}
+
+
+/*
+ * Report task count and checksum of an EEPROM slot
+ */
+void Controller::SlotInfo(const unsigned char slot) {
+  unsigned char count;
+  unsigned short crc;
+  if (!Storage::Verify(slot, count, crc)) {
+    SerialCom::Log(MINLEVEL, PSTR("Slot %u: empty, corrupted or stored on another board"), slot);
     return;
   }
-  digitalWrite(targetPin, mode);
+  SerialCom::Log(MINLEVEL, PSTR("Slot %u: %u tasks, checksum %u"), slot, count, crc);
 }
 
 
@@ -0,0 +1,322 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+
+#include "hwtimer.h"
+#include "trace.h"
+#include "serialcom.h"
+#include "sequence.h"
+#include "stats.h"
+
+
+// init static members
+Action HwTimer::current;
+unsigned short HwTimer::readPos = 0;
+bool HwTimer::pending = false;
+volatile unsigned short HwTimer::overflows = 0;
+volatile bool HwTimer::done = true;
+bool HwTimer::clock = false;
+unsigned short HwTimer::spinWindow = 0;
+unsigned long HwTimer::spinEdges = 0;
+unsigned long HwTimer::spinMissed = 0;
+unsigned short HwTimer::spinMaxLate = 0;
+
+
+/*
+ * Setup Timer1 - stop it and take it over from the arduino core
+ */
+void HwTimer::Setup() {
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TIMSK1 = 0;
+}
+
+
+/*
+ * Play the compiled sequence from the Timer1 compare interrupt.
+ * The timer is restarted so offsets count from now.
+ */
+void HwTimer::Start() {
+  unsigned char oldSREG = SREG;
+  cli();
+  readPos = 0;
+  current.Offset = 0;
+  pending = Sequence::Read(readPos, current);
+  done = false;
+  Restart();
+  Arm();
+  SREG = oldSREG;
+}
+
+
+/*
+ * Only count the time since now - the time base of polled rounds
+ * for the input capture
+ */
+void HwTimer::StartClock() {
+  unsigned char oldSREG = SREG;
+  cli();
+  pending = false;
+  done = true;
+  Restart();
+  SREG = oldSREG;
+}
+
+
+/*
+ * Restart the counter from zero with the overflow interrupt
+ * call with interrupts disabled
+ */
+void HwTimer::Restart() {
+  TCCR1B = 0;
+  TCNT1 = 0;
+  TIFR1 = _BV(OCF1A) | _BV(TOV1);
+  overflows = 0;
+  TIMSK1 = _BV(TOIE1);
+  TCCR1B = _BV(CS11);
+}
+
+
+/*
+ * Keep the counter running after the last action, so events captured
+ * after it still get their time since the start
+ */
+void HwTimer::KeepClock(const bool keep) {
+  clock = keep;
+}
+
+
+/*
+ * Stop playing - remaining actions are dropped
+ */
+void HwTimer::Stop() {
+  unsigned char oldSREG = SREG;
+  cli();
+  TCCR1B = 0;
+  TIMSK1 = 0;
+  done = true;
+  SREG = oldSREG;
+}
+
+
+/*
+ * Set the precision window in us and clear its statistics - 0 switches it off
+ * Edges closer than the window are approached with interrupts disabled,
+ * spinning on the counter until their tick is reached.
+ */
+void HwTimer::SetSpinWindow(const unsigned short window) {
+  unsigned char oldSREG = SREG;
+  cli();
+  spinWindow = window * TIMER_TICKS_PER_US;
+  spinEdges = 0;
+  spinMissed = 0;
+  spinMaxLate = 0;
+  SREG = oldSREG;
+}
+
+
+/*
+ * Report the accuracy reached by the precision window
+ *    edges spun on, max ticks between target and release of the spin,
+ *    edges that were already due when their window opened
+ */
+void HwTimer::SpinInfo() {
+  unsigned char oldSREG = SREG;
+  cli();
+  unsigned long edges = spinEdges;
+  unsigned long missed = spinMissed;
+  unsigned short maxLate = spinMaxLate;
+  SREG = oldSREG;
+  SerialCom::Log(MINLEVEL, PSTR("Spin window: %u us"), (unsigned short)(spinWindow / TIMER_TICKS_PER_US));
+  SerialCom::Log(MINLEVEL, PSTR("P:%lu:%u:%lu:%u"), edges, maxLate, missed, (unsigned short)TIMER_TICKS_PER_US);
+}
+
+
+/*
+ * Offset of the next action in timer ticks
+ */
+unsigned long HwTimer::Ticks() {
+  return current.Offset * TIMER_TICKS_PER_US;
+}
+
+
+/*
+ * Decode the action after the one just fired
+ */
+void HwTimer::Next() {
+  pending = Sequence::Read(readPos, current);
+}
+
+
+/*
+ * Ticks since start - call with interrupts disabled
+ * a pending overflow is counted even if its interrupt did not run yet
+ */
+unsigned long HwTimer::Now() {
+  unsigned short low = TCNT1;
+  unsigned short high = overflows;
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000) {
+    high++;
+  }
+  return ((unsigned long)high << 16) | low;
+}
+
+
+/*
+ * Account the action just fired and add it to the edge timing trace
+ */
+void HwTimer::record() {
+  unsigned long now = Now();
+  Stats::Edge(now > Ticks() ? (now - Ticks()) / TIMER_TICKS_PER_US : 0);
+  if (Trace::IsEnabled()) {
+    Trace::Record(current.Offset, Now() / TIMER_TICKS_PER_US, current.Port, current.SetMask, current.ClearMask);
+  }
+}
+
+
+/*
+ * Fire all actions whose offset has been reached
+ */
+void HwTimer::FireDue() {
+  unsigned long now = Now();
+  while (pending && Ticks() <= now) {
+    Controller::Fire(current);
+    record();
+    Next();
+  }
+}
+
+
+/*
+ * Busy wait for the tick of the next action and fire it together with all
+ * actions sharing its offset - called with interrupts disabled
+ */
+void HwTimer::Spin(const unsigned long target) {
+  // the window is far below half a timer period, 16 bits are enough
+  unsigned short tick = (unsigned short)target;
+  while ((short)(TCNT1 - tick) < 0) {
+  }
+  unsigned short late = TCNT1 - tick;
+  unsigned long offset = current.Offset;
+  do {
+    Controller::Fire(current);
+    record();
+    Next();
+    spinEdges++;
+  } while (pending && current.Offset == offset);
+  if (late > spinMaxLate) {
+    spinMaxLate = late;
+  }
+}
+
+
+/*
+ * Program the compare unit for the next action.
+ * Targets beyond the current timer period are armed from the overflow
+ * interrupt, targets already passed are fired immediately.
+ * With a precision window the compare unit wakes up early and the
+ * remaining ticks are spun. Edges are spun one after another as long as
+ * interrupts stay blocked for MAX_SPIN_WINDOW at most since the interrupt
+ * began, a later edge is spun from a compare match SPIN_GAP later.
+ */
+void HwTimer::Arm() {
+  // the counter is only read for a precision window, arming stays as fast as before without
+  unsigned long entry = spinWindow > 0 ? Now() : 0;
+  while (pending) {
+    unsigned long target = Ticks();
+    unsigned long now = Now();
+    if (target <= now) {
+      if (spinWindow > 0) {
+        spinMissed++;
+      }
+      FireDue();
+      continue;
+    }
+    unsigned long wake = target - spinWindow;
+    if (target - now <= spinWindow) {
+      if (target - entry <= MAX_SPIN_WINDOW * TIMER_TICKS_PER_US) {
+        Spin(target);
+        continue;
+      }
+      wake = now + SPIN_GAP * TIMER_TICKS_PER_US;
+    }
+    if ((wake >> 16) != (now >> 16)) {
+      TIMSK1 &= ~_BV(OCIE1A);
+      return;
+    }
+    OCR1A = (unsigned short)wake;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+    if (Now() < wake) {
+      return;
+    }
+    // counter passed the target while arming
+    TIMSK1 &= ~_BV(OCIE1A);
+  }
+  if (clock) {
+    TIMSK1 &= ~_BV(OCIE1A);
+  } else {
+    TCCR1B = 0;
+    TIMSK1 = 0;
+  }
+  done = true;
+}
+
+
+/*
+ * Compare match - the armed action is due or its precision window opened
+ */
+void HwTimer::OnCompare() {
+  if (spinWindow == 0) {
+    if (pending) {
+      Controller::Fire(current);
+      record();
+      Next();
+    }
+    FireDue();
+  }
+  Arm();
+}
+
+
+/*
+ * Overflow - extend the counter and arm targets of the new period
+ */
+void HwTimer::OnOverflow() {
+  overflows++;
+  if (!done && !(TIMSK1 & _BV(OCIE1A))) {
+    Arm();
+  }
+}
+
+
+ISR(TIMER1_COMPA_vect) {
+  HwTimer::OnCompare();
+}
+
+
+ISR(TIMER1_OVF_vect) {
+  HwTimer::OnOverflow();
+}
@@ -26,26 +26,14 @@
 #include "ardudrop.h"
 #include "serialcom.h"
 #include "controller.h"
-
-//devicemapping for the Uno
-const char deviceMapping[DEVICE_NUMBERS] = {  0,   1,   2,   3,   4,   5,   6,
-                                              7,   8,   9,  10,   11,  12,  13,
-                                           };
-
-//devicemapping for the Mega2560 -> no need if you do not want to use so many pins
-/*
-const char deviceMapping[DEVICE_NUMBERS] = {  0,   1,   2,   3,   4,   5,   6,   7,   8,   9,
-                                       10,  11,  12,  13,  14,  15,  16,  17,  18,  19,
-                                       20,  21,  22,  23,  24,  25,  26,  27,  28,  29,
-                                       30,  31,  32,  33,  34,  35,  36,  37,  38,  39,
-                                       40,  41,  42,  43,  44,  45,  46,  47,  48,  49,
-                                    };
-*/
+#include "stats.h"
+#include "utils.h"
 
 /*
  * setup - run once
  */
 void setup() {
+  paintFreeMemory();
   SerialCom::Setup();
   Controller::Setup();
 }
@@ -55,7 +43,9 @@ void setup() {
  * main loop - do not use long running functions here
  */
 void loop() {
+  unsigned long start = micros();
   Controller::Loop();
+  Stats::Pass(start, micros());
   SerialCom::Loop();  
 }
 
@@ -0,0 +1,125 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+
+#include "sequence.h"
+
+
+// a full task table fits at the typical cost per edge - Compile refuses longer schedules,
+// a schedule is never played in part
+static_assert(SEQUENCE_SIZE >= 2 * MAX_TASKS * SEQ_ACTION_TYPICAL, "sequence too small for the task table");
+static_assert(SEQUENCE_SIZE >= SEQ_ACTION_MAX, "sequence too small for one action");
+
+
+// init static members
+unsigned char Sequence::data[SEQUENCE_SIZE];
+unsigned short Sequence::size = 0;
+unsigned short Sequence::count = 0;
+unsigned long Sequence::lastOffset = 0;
+
+
+/*
+ * Drop all actions
+ */
+void Sequence::Clear() {
+  size = 0;
+  count = 0;
+  lastOffset = 0;
+}
+
+
+/*
+ * Append an action - offsets must not decrease
+ * false if the buffer is full
+ */
+bool Sequence::Append(const Action &action) {
+  unsigned long delta = action.Offset - lastOffset;
+  unsigned char deltaSize = 0;
+  unsigned char code = 0;
+  if (delta > 0xFFFF) {
+    deltaSize = 4;
+    code = 3;
+  } else if (delta > 0xFF) {
+    deltaSize = 2;
+    code = 2;
+  } else if (delta > 0) {
+    deltaSize = 1;
+    code = 1;
+  }
+  unsigned char header = (action.Port & SEQ_PORT) | (code << SEQ_DELTA_SHIFT);
+  if (action.SetMask != 0) {
+    header |= SEQ_SET;
+  }
+  if (action.ClearMask != 0) {
+    header |= SEQ_CLEAR;
+  }
+  unsigned char length = 1 + deltaSize + ((header & SEQ_SET) ? 1 : 0) + ((header & SEQ_CLEAR) ? 1 : 0);
+  if (size + length > SEQUENCE_SIZE) {
+    return false;
+  }
+  data[size++] = header;
+  for (unsigned char i = 0; i < deltaSize; i++) {
+    data[size++] = delta >> (8 * i);
+  }
+  if (header & SEQ_SET) {
+    data[size++] = action.SetMask;
+  }
+  if (header & SEQ_CLEAR) {
+    data[size++] = action.ClearMask;
+  }
+  lastOffset = action.Offset;
+  count++;
+  return true;
+}
+
+
+/*
+ * Decode the action at pos and move pos to the next one
+ * the offset is added to action.Offset - start with 0 at pos 0
+ * false at the end of the sequence
+ */
+bool Sequence::Read(unsigned short &pos, Action &action) {
+  if (pos >= size) {
+    return false;
+  }
+  unsigned char header = data[pos++];
+  unsigned char code = header >> SEQ_DELTA_SHIFT;
+  unsigned long delta = 0;
+  if (code == 3) {
+    delta = data[pos] | ((unsigned short)data[pos + 1] << 8) | ((unsigned long)data[pos + 2] << 16) |
+      ((unsigned long)data[pos + 3] << 24);
+    pos += 4;
+  } else if (code == 2) {
+    delta = data[pos] | ((unsigned short)data[pos + 1] << 8);
+    pos += 2;
+  } else if (code == 1) {
+    delta = data[pos++];
+  }
+  action.Offset += delta;
+  action.Port = header & SEQ_PORT;
+  action.SetMask = (header & SEQ_SET) ? data[pos++] : 0;
+  action.ClearMask = (header & SEQ_CLEAR) ? data[pos++] : 0;
+  return true;
+}
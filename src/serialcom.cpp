@@ -23,17 +23,36 @@
 
 // include arduino types and constants
 #include <Arduino.h>
+#include <stdarg.h>
 
 #include "serialcom.h"
 #include "command.h"
+#include "utils.h"
+#include "controller.h"
 
 
 // init static members
 bool SerialCom::initDone = false;
 char SerialCom::inputChar;
-char SerialCom::inputCmd[MAX_INPUT_SIZE];
-unsigned char SerialCom::inputIdx = 0;
 unsigned char SerialCom::logLevel = DEBUG;
+unsigned char SerialCom::frameState = FRAME_IDLE;
+unsigned char SerialCom::frame[MAX_FRAME_SIZE];
+unsigned char SerialCom::frameLength = 0;
+unsigned char SerialCom::frameIdx = 0;
+unsigned short SerialCom::frameCrc = CRC16_INIT;
+unsigned short SerialCom::frameCrcReceived = 0;
+unsigned long SerialCom::frameTime = 0;
+unsigned char SerialCom::rxBuffer[RX_BUFFER_SIZE];
+unsigned char SerialCom::rxHead = 0;
+unsigned char SerialCom::rxTail = 0;
+bool SerialCom::rxLost = false;
+unsigned char SerialCom::rxLostIdx = 0;
+unsigned short SerialCom::rxOverflows = 0;
+char SerialCom::txBuffer[TX_BUFFER_SIZE];
+unsigned char SerialCom::txHead = 0;
+unsigned char SerialCom::txTail = 0;
+unsigned short SerialCom::txDropped = 0;
+unsigned short SerialCom::errors = 0;
 
 
 // setup serial communication - call once at startup
@@ -51,42 +70,249 @@ void SerialCom::Setup() {
 
 
 // cyclic called task - check serial-input for next command
+// everything received is buffered, parsing is limited to a budget per call
 void SerialCom::Loop() {
   if (!initDone) { // exit if not connected first
     return;
   }
-  if (inputIdx >= MAX_INPUT_SIZE) { // exit and reset input if cmd is too long
-    inputIdx = 0;
-    Log(INFO, ("Command to long, dismissed - max: " + (String)MAX_INPUT_SIZE).c_str());
+  drainRx();
+  flushTx();
+  if (frameState != FRAME_IDLE && millis() - frameTime > FRAME_TIMEOUT) {
+    frameState = FRAME_IDLE;
+    Log(ERROR, PSTR("Frame timeout"));
+  }
+  unsigned char budget = Controller::IsRunning() ? RX_BUDGET_RUNNING : RX_BUDGET_IDLE;
+  while (budget > 0 && rxTail != rxHead) {
+    // bytes following this position were dropped - the command is incomplete
+    if (rxLost && rxTail == rxLostIdx) {
+      rxLost = false;
+      if (frameState == FRAME_IDLE) {
+        Command::Abort(PSTR("Command dismissed - receive buffer overflow"));
+      }
+    }
+    unsigned char data = rxBuffer[rxTail];
+    rxTail = (rxTail + 1) & (RX_BUFFER_SIZE - 1);
+    processByte(data);
+    budget--;
+  }
+}
+
+
+// move everything the UART received into the ring buffer
+void SerialCom::drainRx() {
+  while (Serial.available()) {
+    Receive((unsigned char) Serial.read());
+  }
+}
+
+
+// put one received byte into the ring buffer, Loop parses it
+// bytes that do not fit are counted and dropped
+void SerialCom::Receive(const unsigned char data) {
+  unsigned char next = (rxHead + 1) & (RX_BUFFER_SIZE - 1);
+  if (next == rxTail) {
+    if (!rxLost) {
+      rxLost = true;
+      rxLostIdx = rxHead;
+    }
+    rxOverflows++;
     return;
   }
-  if (Serial.available()) {
-    inputChar = (char) Serial.read();
-    if (inputChar == '\n') {
-      inputCmd[inputIdx] = '\0';
-      inputIdx = 0;
-      Log(DEBUG, inputCmd);
-      Command::ParseCommand(inputCmd);
-    } else {
-      inputCmd[inputIdx] = inputChar;
-      inputIdx++;
+  rxBuffer[rxHead] = data;
+  rxHead = next;
+}
+
+
+// pass one received byte to the frame receiver or the text parser
+void SerialCom::processByte(const unsigned char data) {
+  inputChar = (char) data;
+  if (frameState != FRAME_IDLE) {
+    readFrameByte(data);
+  } else if (Command::AtLineStart() && data == FRAME_START) {
+    // binary frames may only start at the beginning of a line
+    frameState = FRAME_LENGTH;
+    frameTime = millis();
+  } else {
+    Command::Feed(inputChar);
+  }
+}
+
+
+// receive one byte of a binary frame and dispatch the frame once complete
+void SerialCom::readFrameByte(const unsigned char data) {
+  frameTime = millis();
+  switch (frameState)
+  {
+  case FRAME_LENGTH:
+    if (data == 0 || data > MAX_FRAME_SIZE) {
+      frameState = FRAME_IDLE;
+      Log(ERROR, PSTR("Wrong frame length"));
+      return;
+    }
+    frameLength = data;
+    frameIdx = 0;
+    frameCrc = crc16Update(CRC16_INIT, data);
+    frameState = FRAME_PAYLOAD;
+    break;
+  case FRAME_PAYLOAD:
+    frame[frameIdx++] = data;
+    frameCrc = crc16Update(frameCrc, data);
+    if (frameIdx >= frameLength) {
+      frameState = FRAME_CRC_LOW;
     }
+    break;
+  case FRAME_CRC_LOW:
+    frameCrcReceived = data;
+    frameState = FRAME_CRC_HIGH;
+    break;
+  case FRAME_CRC_HIGH:
+    frameCrcReceived |= (unsigned short)data << 8;
+    frameState = FRAME_IDLE;
+    if (frameCrcReceived != frameCrc) {
+      Log(ERROR, PSTR("Wrong CRC"));
+      return;
+    }
+    Command::ParseFrame(frame, frameLength);
+    break;
+  default:
+    frameState = FRAME_IDLE;
+    break;
   }
 }
 
 
-void SerialCom::Log(const unsigned char level, const char* message) {
+// format a message into the transmit buffer - never blocks while a task runs
+// format is a PROGMEM string, supported conversions: %u %d %lu %ld %c %s %S(PROGMEM) %%
+// while a task runs the message is dropped and counted if it does not fit into the buffer
+void SerialCom::Log(const unsigned char level, const char* format, ...) {
   if (!initDone) { // exit if not connected first
     return;
   }
-  if(level <= logLevel) {
-    Serial.println(message);
+  // errors are counted even if filtered - sequenced commands are refused by them
+  if (level == ERROR) {
+    errors++;
+  }
+  if (level > logLevel && level != MINLEVEL) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  unsigned char start = txHead;
+  bool ok = true;
+  char c;
+  while (ok && (c = pgm_read_byte(format++)) != '\0') {
+    if (c != '%') {
+      ok = putTx(c);
+      continue;
+    }
+    bool isLong = false;
+    c = pgm_read_byte(format++);
+    if (c == 'l') {
+      isLong = true;
+      c = pgm_read_byte(format++);
+    }
+    switch (c)
+    {
+    case 'u':
+      ok = putNumber(isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int));
+      break;
+    case 'd':
+      {
+        long number = isLong ? va_arg(args, long) : va_arg(args, int);
+        if (number < 0) {
+          ok = putTx('-') && putNumber(0UL - (unsigned long)number);
+        } else {
+          ok = putNumber(number);
+        }
+      }
+      break;
+    case 'c':
+      ok = putTx((char)va_arg(args, int));
+      break;
+    case 's':
+      {
+        const char* str = va_arg(args, const char*);
+        while (ok && *str != '\0') {
+          ok = putTx(*str++);
+        }
+      }
+      break;
+    case 'S':
+      {
+        const char* str = va_arg(args, const char*);
+        char strChar;
+        while (ok && (strChar = pgm_read_byte(str++)) != '\0') {
+          ok = putTx(strChar);
+        }
+      }
+      break;
+    case '\0':
+      format--;
+      break;
+    default:
+      ok = putTx(c);
+      break;
+    }
+  }
+  va_end(args);
+  ok = ok && putTx('\r') && putTx('\n');
+  if (!ok) {
+    txHead = start;
+    txDropped++;
+  }
+  flushTx();
+}
+
+
+// append one character to the transmit buffer
+// while idle a full buffer is drained blocking, while a task runs false is returned
+// while blocking the UART input is moved into the ring buffer, so no received byte is lost uncounted
+bool SerialCom::putTx(const char c) {
+  unsigned char next = (txHead + 1) & (TX_BUFFER_SIZE - 1);
+  if (next == txTail) {
+    if (Controller::IsRunning()) {
+      return false;
+    }
+    drainRx();
+    Serial.write(txBuffer[txTail]);
+    drainRx();
+    txTail = (txTail + 1) & (TX_BUFFER_SIZE - 1);
+  }
+  txBuffer[txHead] = c;
+  txHead = next;
+  return true;
+}
+
+
+// append decimal representation of number to the transmit buffer
+bool SerialCom::putNumber(unsigned long number) {
+  char digits[10];
+  unsigned char count = 0;
+  do {
+    digits[count++] = '0' + number % 10;
+    number /= 10;
+  } while (number > 0);
+  while (count > 0) {
+    if (!putTx(digits[--count])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// hand buffered characters to the UART as far as it accepts them without blocking
+void SerialCom::flushTx() {
+  int room = Serial.availableForWrite();
+  while (room > 0 && txTail != txHead) {
+    Serial.write(txBuffer[txTail]);
+    txTail = (txTail + 1) & (TX_BUFFER_SIZE - 1);
+    room--;
   }
 }
 
 
 void SerialCom::SetLogLevel(const unsigned char level) {
   logLevel = level > MAXLEVEL?MAXLEVEL:level;
-  logLevel = level < MINLEVEL?MINLEVEL:level;
-  Log(INFO, ("Loglevel is set to " + (String)logLevel).c_str());
+  Log(INFO, PSTR("Loglevel is set to %u"), logLevel);
 }
@@ -0,0 +1,171 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+
+#include "stats.h"
+#include "serialcom.h"
+
+
+// init static members
+unsigned long Stats::passes = 0;
+unsigned long Stats::samples = 0;
+unsigned long Stats::lastStart = 0;
+unsigned long Stats::lastSplit = 0;
+unsigned long Stats::periodSum = 0;
+unsigned long Stats::maxPeriod = 0;
+unsigned long Stats::controllerSum = 0;
+unsigned long Stats::maxController = 0;
+unsigned long Stats::serialSum = 0;
+unsigned long Stats::maxSerial = 0;
+volatile unsigned long Stats::edges = 0;
+volatile unsigned long Stats::maxLate = 0;
+volatile unsigned long Stats::missed = 0;
+volatile bool Stats::roundMissed = false;
+unsigned long Stats::badRounds = 0;
+unsigned long Stats::deadline = 0;
+unsigned char Stats::policy = DEADLINE_COUNT;
+
+
+/*
+ * Clear all counters - the deadline is kept
+ */
+void Stats::Reset() {
+  unsigned char oldSREG = SREG;
+  cli();
+  passes = 0;
+  samples = 0;
+  periodSum = 0;
+  maxPeriod = 0;
+  controllerSum = 0;
+  maxController = 0;
+  serialSum = 0;
+  maxSerial = 0;
+  edges = 0;
+  maxLate = 0;
+  missed = 0;
+  roundMissed = false;
+  badRounds = 0;
+  SREG = oldSREG;
+}
+
+
+/*
+ * Set the lateness in us an edge may have - 0 switches the check off
+ */
+void Stats::SetDeadline(const unsigned long newDeadline, const unsigned char newPolicy) {
+  deadline = newDeadline;
+  policy = newPolicy;
+  Reset();
+}
+
+
+/*
+ * Account one pass of loop() - called between Controller::Loop and
+ * SerialCom::Loop with the micros() before and after Controller::Loop.
+ * The SerialCom::Loop part of a pass is known at the start of the next one.
+ * The sums are halved with their sample count before they could wrap, so
+ * the means stay valid on long runs and weigh the recent passes more.
+ */
+void Stats::Pass(const unsigned long start, const unsigned long split) {
+  unsigned long controller = split - start;
+  if (controller > maxController) {
+    maxController = controller;
+  }
+  if (passes > 0) {
+    unsigned long period = start - lastStart;
+    if (period > maxPeriod) {
+      maxPeriod = period;
+    }
+    unsigned long serial = start - lastSplit;
+    if (serial > maxSerial) {
+      maxSerial = serial;
+    }
+    // the period holds the controller and serial parts - its sum is the largest
+    if (periodSum >= STATS_SUM_LIMIT || period >= STATS_SUM_LIMIT) {
+      periodSum /= 2;
+      controllerSum /= 2;
+      serialSum /= 2;
+      samples /= 2;
+    }
+    periodSum += period;
+    controllerSum += controller;
+    serialSum += serial;
+    samples++;
+  }
+  lastStart = start;
+  lastSplit = split;
+  passes++;
+}
+
+
+/*
+ * Account one fired action with its lateness in us
+ * called from the timer interrupt and the polled loop
+ */
+void Stats::Edge(const unsigned long lateness) {
+  edges++;
+  if (lateness > maxLate) {
+    maxLate = lateness;
+  }
+  if (deadline > 0 && lateness > deadline) {
+    missed++;
+    roundMissed = true;
+  }
+}
+
+
+/*
+ * Print the loop period and the late edges for the info command
+ */
+void Stats::Summary() {
+  unsigned char oldSREG = SREG;
+  cli();
+  unsigned long lateEdges = missed;
+  SREG = oldSREG;
+  unsigned long mean = samples > 0 ? periodSum / samples : 0;
+  SerialCom::Log(MINLEVEL, PSTR("Loop: %lu passes, period mean %lu us max %lu us"), passes, mean, maxPeriod);
+  SerialCom::Log(MINLEVEL, PSTR("Late edges: %lu"), lateEdges);
+}
+
+
+/*
+ * Print all counters
+ *    passes, mean and max period, mean and max Controller::Loop,
+ *    mean and max SerialCom::Loop, edges, max lateness, late edges, bad rounds
+ */
+void Stats::Info() {
+  unsigned char oldSREG = SREG;
+  cli();
+  unsigned long fired = edges;
+  unsigned long late = maxLate;
+  unsigned long lateEdges = missed;
+  SREG = oldSREG;
+  unsigned long mean = samples > 0 ? periodSum / samples : 0;
+  SerialCom::Log(MINLEVEL, PSTR("Deadline: %lu us, policy: %u"), deadline, policy);
+  SerialCom::Log(MINLEVEL, PSTR("Y:%lu:%lu:%lu:%lu:%lu:%lu:%lu"), passes, mean, maxPeriod,
+                 samples > 0 ? controllerSum / samples : 0, maxController,
+                 samples > 0 ? serialSum / samples : 0, maxSerial);
+  SerialCom::Log(MINLEVEL, PSTR("Z:%lu:%lu:%lu:%lu"), fired, late, lateEdges, badRounds);
+}
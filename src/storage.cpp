@@ -0,0 +1,221 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "storage.h"
+#include "command.h"
+#include "serialcom.h"
+#include "utils.h"
+
+
+static_assert(EEPROM_LATENCY_BASE + 4 + DEVICE_NUMBERS * 4 <= EEPROM_SLOT_BASE, "latency profiles overlap the schedule slots");
+static_assert(EEPROM_SLOT_BASE + EEPROM_SLOTS * (unsigned long)SLOT_SIZE <= E2END + 1UL, "schedule slots exceed the EEPROM of the board");
+
+
+/*
+ * Store tasks with their sweep steps in a slot
+ * the magic byte is written last so an interrupted write leaves an invalid slot
+ */
+bool Storage::Save(const unsigned char slot, const Task* tasks, const unsigned char count, const TaskSteps* steps) {
+  if (slot >= EEPROM_SLOTS || count > MAX_TASKS) {
+    return false;
+  }
+  unsigned short address = slotAddress(slot);
+  EEPROM.update(address, 0);
+  unsigned short crc = crc16Update(CRC16_INIT, count);
+  unsigned short taskAddress = address + SLOT_HEADER_SIZE;
+  for (unsigned char i = 0; i < count; i++) {
+    long offsetStep = tasks[i].Steps == NO_STEPS ? 0 : steps[tasks[i].Steps].OffsetStep;
+    long durationStep = tasks[i].Steps == NO_STEPS ? 0 : steps[tasks[i].Steps].DurationStep;
+    EEPROM.update(taskAddress, tasks[i].Device);
+    writeU32(taskAddress + 1, tasks[i].Offset);
+    writeU32(taskAddress + 5, tasks[i].Duration);
+    writeU32(taskAddress + 9, offsetStep);
+    writeU32(taskAddress + 13, durationStep);
+    crc = crc16Update(crc, tasks[i].Device);
+    crc = crcU32(crc, tasks[i].Offset);
+    crc = crcU32(crc, tasks[i].Duration);
+    crc = crcU32(crc, offsetStep);
+    crc = crcU32(crc, durationStep);
+    taskAddress += SLOT_TASK_SIZE;
+  }
+  EEPROM.update(address + 1, count);
+  EEPROM.update(address + 2, crc & 0xFF);
+  EEPROM.update(address + 3, crc >> 8);
+  EEPROM.update(address + 4, DEVICE_NUMBERS);
+  EEPROM.update(address, SLOT_MAGIC);
+  return true;
+}
+
+
+/*
+ * Load tasks of a slot with their sweep steps - tasks are only touched if
+ * the slot is valid, all its devices exist on this board and its sweeping
+ * tasks fit into the step table
+ */
+bool Storage::Load(const unsigned char slot, Task* tasks, unsigned char &count, TaskSteps* steps,
+                   unsigned char &stepCount) {
+  unsigned short crc;
+  if (!Verify(slot, count, crc)) {
+    return false;
+  }
+  unsigned short taskAddress = slotAddress(slot) + SLOT_HEADER_SIZE;
+  unsigned char sweeping = 0;
+  for (unsigned char i = 0; i < count; i++) {
+    unsigned short address = taskAddress + i * SLOT_TASK_SIZE;
+    unsigned char device = EEPROM.read(address);
+    if (device >= DEVICE_NUMBERS) {
+      SerialCom::Log(ERROR, PSTR("slot %u holds device %u - not on this board"), slot, device);
+      return false;
+    }
+    if (readU32(address + 9) != 0 || readU32(address + 13) != 0) {
+      sweeping++;
+    }
+  }
+  if (sweeping > MAX_SWEEPS) {
+    SerialCom::Log(ERROR, PSTR("slot %u holds %u sweeping tasks - more than %u"), slot, sweeping, MAX_SWEEPS);
+    return false;
+  }
+  stepCount = 0;
+  for (unsigned char i = 0; i < count; i++) {
+    tasks[i].Device = EEPROM.read(taskAddress);
+    tasks[i].Offset = readU32(taskAddress + 1);
+    tasks[i].Duration = readU32(taskAddress + 5);
+    tasks[i].Steps = NO_STEPS;
+    long offsetStep = readU32(taskAddress + 9);
+    long durationStep = readU32(taskAddress + 13);
+    if (offsetStep != 0 || durationStep != 0) {
+      steps[stepCount].OffsetStep = offsetStep;
+      steps[stepCount].DurationStep = durationStep;
+      tasks[i].Steps = stepCount++;
+    }
+    taskAddress += SLOT_TASK_SIZE;
+  }
+  return true;
+}
+
+
+/*
+ * Check magic, board and checksum of a slot
+ */
+bool Storage::Verify(const unsigned char slot, unsigned char &count, unsigned short &crc) {
+  if (slot >= EEPROM_SLOTS) {
+    return false;
+  }
+  unsigned short address = slotAddress(slot);
+  if (EEPROM.read(address) != SLOT_MAGIC || EEPROM.read(address + 4) != DEVICE_NUMBERS) {
+    return false;
+  }
+  count = EEPROM.read(address + 1);
+  if (count > MAX_TASKS) {
+    return false;
+  }
+  unsigned short stored = readU16(address + 2);
+  crc = crc16Update(CRC16_INIT, count);
+  unsigned short end = address + SLOT_HEADER_SIZE + count * SLOT_TASK_SIZE;
+  for (unsigned short i = address + SLOT_HEADER_SIZE; i < end; i++) {
+    crc = crc16Update(crc, EEPROM.read(i));
+  }
+  return crc == stored;
+}
+
+
+/*
+ * Store the latency profiles of all devices
+ */
+void Storage::SaveLatency(const unsigned short* onLags, const unsigned short* offLags) {
+  unsigned short address = EEPROM_LATENCY_BASE;
+  EEPROM.update(address, 0);
+  unsigned short crc = crc16Update(CRC16_INIT, DEVICE_NUMBERS);
+  for (unsigned char i = 0; i < DEVICE_NUMBERS; i++) {
+    unsigned short lagAddress = address + 4 + i * 4;
+    EEPROM.update(lagAddress, onLags[i] & 0xFF);
+    EEPROM.update(lagAddress + 1, onLags[i] >> 8);
+    EEPROM.update(lagAddress + 2, offLags[i] & 0xFF);
+    EEPROM.update(lagAddress + 3, offLags[i] >> 8);
+    for (unsigned char j = 0; j < 4; j++) {
+      crc = crc16Update(crc, EEPROM.read(lagAddress + j));
+    }
+  }
+  EEPROM.update(address + 1, DEVICE_NUMBERS);
+  EEPROM.update(address + 2, crc & 0xFF);
+  EEPROM.update(address + 3, crc >> 8);
+  EEPROM.update(address, LATENCY_MAGIC);
+}
+
+
+/*
+ * Load the latency profiles - false if none are stored for this board
+ */
+bool Storage::LoadLatency(unsigned short* onLags, unsigned short* offLags) {
+  unsigned short address = EEPROM_LATENCY_BASE;
+  if (EEPROM.read(address) != LATENCY_MAGIC || EEPROM.read(address + 1) != DEVICE_NUMBERS) {
+    return false;
+  }
+  unsigned short crc = crc16Update(CRC16_INIT, DEVICE_NUMBERS);
+  for (unsigned short i = address + 4; i < address + 4 + DEVICE_NUMBERS * 4; i++) {
+    crc = crc16Update(crc, EEPROM.read(i));
+  }
+  if (crc != readU16(address + 2)) {
+    return false;
+  }
+  for (unsigned char i = 0; i < DEVICE_NUMBERS; i++) {
+    onLags[i] = readU16(address + 4 + i * 4);
+    offLags[i] = readU16(address + 6 + i * 4);
+  }
+  return true;
+}
+
+
+unsigned short Storage::slotAddress(const unsigned char slot) {
+  return EEPROM_SLOT_BASE + slot * SLOT_SIZE;
+}
+
+
+unsigned short Storage::readU16(const unsigned short address) {
+  return EEPROM.read(address) | ((unsigned short)EEPROM.read(address + 1) << 8);
+}
+
+
+unsigned long Storage::readU32(const unsigned short address) {
+  return (unsigned long)EEPROM.read(address) | ((unsigned long)EEPROM.read(address + 1) << 8) |
+    ((unsigned long)EEPROM.read(address + 2) << 16) | ((unsigned long)EEPROM.read(address + 3) << 24);
+}
+
+
+void Storage::writeU32(const unsigned short address, const unsigned long value) {
+  for (unsigned char i = 0; i < 4; i++) {
+    EEPROM.update(address + i, (value >> (8 * i)) & 0xFF);
+  }
+}
+
+
+unsigned short Storage::crcU32(unsigned short crc, const unsigned long value) {
+  for (unsigned char i = 0; i < 4; i++) {
+    crc = crc16Update(crc, (value >> (8 * i)) & 0xFF);
+  }
+  return crc;
+}
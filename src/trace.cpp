@@ -0,0 +1,145 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+// include arduino types and constants
+#include <Arduino.h>
+
+#include "trace.h"
+#include "serialcom.h"
+
+
+// init static members
+bool Trace::enabled = false;
+unsigned char Trace::round = 0;
+TraceEntry Trace::entries[TRACE_SIZE];
+unsigned char Trace::entryIdx = 0;
+unsigned long Trace::count = 0;
+unsigned long Trace::sum = 0;
+unsigned short Trace::minLateness = 0xFFFF;
+unsigned short Trace::maxLateness = 0;
+unsigned short Trace::histogram[TRACE_BUCKETS];
+TriggerEntry Trace::triggers[TRACE_TRIGGERS];
+unsigned long Trace::triggerCount = 0;
+
+
+/*
+ * Switch tracing on or off - enabling clears trace and statistics
+ */
+void Trace::Enable(const bool enable) {
+  unsigned char oldSREG = SREG;
+  cli();
+  if (enable) {
+    entryIdx = 0;
+    count = 0;
+    sum = 0;
+    minLateness = 0xFFFF;
+    maxLateness = 0;
+    for (unsigned char i = 0; i < TRACE_BUCKETS; i++) {
+      histogram[i] = 0;
+    }
+    triggerCount = 0;
+  }
+  enabled = enable;
+  SREG = oldSREG;
+  SerialCom::Log(INFO, PSTR("Trace is set to %u"), enabled);
+}
+
+
+/*
+ * Record a fired action - may be called from the timer interrupt
+ * times in us since start of the round, the masks tell the pins switched by the action
+ */
+void Trace::Record(const unsigned long scheduled, const unsigned long actual, const unsigned char port,
+    const unsigned char setMask, const unsigned char clearMask) {
+  unsigned long late = actual > scheduled ? actual - scheduled : 0;
+  unsigned short lateness = late > 0xFFFF ? 0xFFFF : late;
+  TraceEntry &entry = entries[entryIdx];
+  entry.Scheduled = scheduled;
+  entry.Lateness = lateness;
+  entry.Port = port;
+  entry.SetMask = setMask;
+  entry.ClearMask = clearMask;
+  entry.Round = round;
+  entryIdx = (entryIdx + 1) % TRACE_SIZE;
+  count++;
+  sum += lateness;
+  if (lateness < minLateness) {
+    minLateness = lateness;
+  }
+  if (lateness > maxLateness) {
+    maxLateness = lateness;
+  }
+  // bucket is the number of significant bits
+  unsigned char bucket = 0;
+  while (lateness > 0 && bucket < TRACE_BUCKETS - 1) {
+    lateness >>= 1;
+    bucket++;
+  }
+  histogram[bucket]++;
+}
+
+
+/*
+ * Record the hardware trigger that started the current round
+ * time in us as returned by micros()
+ */
+void Trace::Trigger(const unsigned long time) {
+  if (!enabled) {
+    return;
+  }
+  TriggerEntry &entry = triggers[triggerCount % TRACE_TRIGGERS];
+  entry.Time = time;
+  entry.Round = round;
+  triggerCount++;
+}
+
+
+/*
+ * Dump statistics, histogram and the latest entries
+ *    T:count:min:max:mean
+ *    H:bucket0:bucket1:...
+ *    E:round:port:setMask:clearMask:scheduled:lateness - oldest first
+ *    G:round:time - latest hardware triggers, oldest first
+ */
+void Trace::Dump() {
+  if (count == 0) {
+    SerialCom::Log(MINLEVEL, PSTR("No trace recorded!"));
+    return;
+  }
+  SerialCom::Log(MINLEVEL, PSTR("T:%lu:%u:%u:%lu"), count, minLateness, maxLateness, sum / count);
+  SerialCom::Log(MINLEVEL, PSTR("H:%u:%u:%u:%u:%u:%u:%u:%u:%u:%u"), histogram[0], histogram[1], histogram[2], histogram[3],
+    histogram[4], histogram[5], histogram[6], histogram[7], histogram[8], histogram[9]);
+  unsigned char stored = count < TRACE_SIZE ? count : TRACE_SIZE;
+  unsigned char idx = count < TRACE_SIZE ? 0 : entryIdx;
+  for (unsigned char i = 0; i < stored; i++) {
+    const TraceEntry &entry = entries[idx];
+    SerialCom::Log(MINLEVEL, PSTR("E:%u:%u:%u:%u:%lu:%u"), entry.Round, entry.Port, entry.SetMask, entry.ClearMask,
+      entry.Scheduled, entry.Lateness);
+    idx = (idx + 1) % TRACE_SIZE;
+  }
+  unsigned long first = triggerCount > TRACE_TRIGGERS ? triggerCount - TRACE_TRIGGERS : 0;
+  for (unsigned long i = first; i < triggerCount; i++) {
+    const TriggerEntry &entry = triggers[i % TRACE_TRIGGERS];
+    SerialCom::Log(MINLEVEL, PSTR("G:%u:%lu"), entry.Round, entry.Time);
+  }
+}
@@ -24,18 +24,72 @@
 
 #include <Arduino.h>
 
+#ifdef __AVR__
 
-// return free RAM memory
+#define MEMORY_CANARY 0xA5 // fill pattern for unused RAM
+#define MEMORY_MARGIN   32 // bytes below the stack pointer left untouched
+
+// provided by avr-libc: start and current end of the heap
+extern char __heap_start;
+extern char *__brkval;
+
+
+// current end of the heap
+static char* heapEnd() {
+  return __brkval != NULL ? __brkval : &__heap_start;
+}
+
+
+// return free RAM memory between heap and stack
 unsigned short freeMemory() {
-  unsigned short counter = 0;
-  byte *bytes;
+  char top;
+  return &top - heapEnd();
+}
 
-  // grab as much bytes as possible
-  while ( (bytes = (byte*) malloc (counter * sizeof(byte))) != NULL ) {
+
+// fill free RAM with a canary so the high-water mark can be found later
+void paintFreeMemory() {
+  char top;
+  for (char *p = heapEnd(); p < &top - MEMORY_MARGIN; p++) {
+    *p = MEMORY_CANARY;
+  }
+}
+
+
+// return the minimum of free RAM since paintFreeMemory()
+// the canary bytes above the heap were never touched by heap or stack
+unsigned short minFreeMemory() {
+  unsigned short counter = 0;
+  for (char *p = heapEnd(); *p == (char)MEMORY_CANARY; p++) {
     counter++;
-    free(bytes);
   }
-  
-  free(bytes);
   return counter;
 }
+
+#else
+
+// host build - there is no gap between heap and stack to measure
+unsigned short freeMemory() {
+  return 0;
+}
+
+
+void paintFreeMemory() {
+}
+
+
+unsigned short minFreeMemory() {
+  return 0;
+}
+
+#endif
+
+
+// update CRC-16/CCITT (polynomial 0x1021, start with 0xFFFF) by one byte
+unsigned short crc16Update(unsigned short crc, const unsigned char data) {
+  crc ^= (unsigned short)data << 8;
+  for (unsigned char i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
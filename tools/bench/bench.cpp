@@ -0,0 +1,449 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/*
+ * Benchmark suite - replaces src/main.cpp
+ * Measures the parser, the staging and commit of schedules, the passes of
+ * Controller::Loop and SerialCom::Loop under serial load and the memory
+ * probes. Every result is printed as one JSON line starting with '{':
+ *   {"bench":"commit","param":64,"bytes":0,"unit":"cycles","n":20,"min":..,"mean":..,"max":..}
+ * param is the variant of the benchmark (timings per line, tasks, execution
+ * mode), bytes the input size of one run.
+ *
+ * On the Mega2560 Timer5 counts cpu cycles - exact on the board and under
+ * simavr. On the host the monotonic clock counts nanoseconds and the virtual
+ * clock of lib/NativeHal moves between the loop passes.
+ */
+
+#include <Arduino.h>
+
+#include "ardudrop.h"
+#include "command.h"
+#include "controller.h"
+#include "serialcom.h"
+#include "utils.h"
+
+#if defined(__AVR_ATmega2560__)
+  #define BENCH_UNIT "cycles"
+  #define BENCH_TARGET "atmega2560"
+#elif !defined(__AVR__)
+  #include <time.h>
+  #include "NativeHal.h"
+  #define BENCH_UNIT "ns"
+  #define BENCH_TARGET "host"
+#else
+  #error "the benchmark counts cycles with Timer5 of the Mega2560"
+#endif
+
+#define BENCH_REPEAT     200 // runs of the parser and memory benchmarks
+#define BENCH_COMMITS     20 // commits per schedule size
+#define BENCH_ADDS       512 // timed AddTask calls, the table is cleared when full
+#define BENCH_PASSES   20000 // loop passes under serial load
+#define BENCH_RESULTS     16
+#define BENCH_LINE_SIZE  160
+#define BENCH_PASS_US     10 // virtual time of one loop pass on the host
+#define BENCH_BYTE_US   1042 // one byte at 9600 baud
+
+
+// statistics of one benchmark
+struct Result {
+  const char* Name; // in program memory
+  unsigned char Param;
+  unsigned char Bytes;
+  unsigned long Count;
+  unsigned long Min;
+  unsigned long Max;
+  unsigned long Sum;
+};
+
+static Result results[BENCH_RESULTS];
+static unsigned char resultCount = 0;
+
+// serial load - one set command every line, sent byte by byte
+static char loadLine[BENCH_LINE_SIZE];
+#if defined(__AVR__)
+static unsigned char loadPos = 0;
+static unsigned long loadTime = 0;
+#endif
+
+
+/*
+ * Clock
+ */
+#if defined(__AVR_ATmega2560__)
+
+static volatile unsigned short overflows = 0;
+
+ISR(TIMER5_OVF_vect) {
+  overflows++;
+}
+
+
+static void clockSetup() {
+  TCCR5B = 0;
+  TCCR5A = 0;
+  TCNT5 = 0;
+  TIFR5 = _BV(TOV5);
+  overflows = 0;
+  TIMSK5 = _BV(TOIE5);
+  TCCR5B = _BV(CS50);
+}
+
+
+// cpu cycles - a pending overflow is counted even if its interrupt did not run yet
+static unsigned long clockNow() {
+  unsigned char oldSREG = SREG;
+  cli();
+  unsigned short low = TCNT5;
+  unsigned short high = overflows;
+  if ((TIFR5 & _BV(TOV5)) && low < 0x8000) {
+    high++;
+  }
+  SREG = oldSREG;
+  return ((unsigned long)high << 16) | low;
+}
+
+
+// the firmware runs in real time
+static void pace() {
+}
+
+#else
+
+static void clockSetup() {
+}
+
+
+static unsigned long clockNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+// let the virtual clock run - timer interrupts and serial bytes are processed
+static void pace() {
+  NativeHal::Advance(BENCH_PASS_US);
+}
+
+#endif
+
+
+/*
+ * Results
+ */
+static Result* begin(const char* name, const unsigned char param, const unsigned char bytes) {
+  if (resultCount >= BENCH_RESULTS) {
+    resultCount--; // the last one is overwritten
+  }
+  Result* result = &results[resultCount++];
+  result->Name = name;
+  result->Param = param;
+  result->Bytes = bytes;
+  result->Count = 0;
+  result->Min = 0xFFFFFFFFUL;
+  result->Max = 0;
+  result->Sum = 0;
+  return result;
+}
+
+
+static void record(Result* result, const unsigned long time) {
+  if (time < result->Min) {
+    result->Min = time;
+  }
+  if (time > result->Max) {
+    result->Max = time;
+  }
+  result->Sum += time;
+  result->Count++;
+}
+
+
+static void put(const char* text) {
+  while (*text != '\0') {
+    Serial.write(*text++);
+  }
+}
+
+
+static void putP(const char* text) {
+  char c;
+  while ((c = pgm_read_byte(text++)) != '\0') {
+    Serial.write(c);
+  }
+}
+
+
+static char* appendNumber(char* buffer, unsigned long number) {
+  char digits[10];
+  unsigned char count = 0;
+  do {
+    digits[count++] = '0' + number % 10;
+    number /= 10;
+  } while (number > 0);
+  while (count > 0) {
+    *buffer++ = digits[--count];
+  }
+  *buffer = '\0';
+  return buffer;
+}
+
+
+static void putNumber(const char* key, const unsigned long number) {
+  char buffer[11];
+  putP(key);
+  appendNumber(buffer, number);
+  put(buffer);
+}
+
+
+static void report() {
+  putP(PSTR("{\"suite\":\"ardudrop\",\"target\":\"" BENCH_TARGET "\",\"unit\":\"" BENCH_UNIT "\"}\n"));
+  for (unsigned char i = 0; i < resultCount; i++) {
+    Result* result = &results[i];
+    putP(PSTR("{\"bench\":\""));
+    putP(result->Name);
+    putNumber(PSTR("\",\"param\":"), result->Param);
+    putNumber(PSTR(",\"bytes\":"), result->Bytes);
+    putP(PSTR(",\"unit\":\"" BENCH_UNIT "\""));
+    putNumber(PSTR(",\"n\":"), result->Count);
+    putNumber(PSTR(",\"min\":"), result->Count > 0 ? result->Min : 0);
+    putNumber(PSTR(",\"mean\":"), result->Count > 0 ? result->Sum / result->Count : 0);
+    putNumber(PSTR(",\"max\":"), result->Max);
+    putP(PSTR("}\n"));
+  }
+}
+
+
+/*
+ * Workloads
+ */
+
+// a set command of a valve with the given number of timings
+static unsigned char setLine(char* line, const unsigned char device, const unsigned char timings) {
+  char* p = line;
+  unsigned long sum = 0;
+  *p++ = 'S';
+  *p++ = ';';
+  p = appendNumber(p, device);
+  *p++ = ';';
+  *p++ = 'V';
+  for (unsigned char i = 0; i < timings; i++) {
+    unsigned long offset = 10000UL + i * 25000UL;
+    unsigned long duration = 5000UL + i * 100UL;
+    *p++ = ';';
+    p = appendNumber(p, offset);
+    *p++ = '|';
+    p = appendNumber(p, duration);
+    sum += offset + duration;
+  }
+  *p++ = '^';
+  p = appendNumber(p, sum);
+  *p++ = '\n';
+  *p = '\0';
+  return p - line;
+}
+
+
+// stage a schedule of the given size spread over the devices
+// 0 and 1 are left out as they are the serial pins
+static void stage(const unsigned char count) {
+  Controller::DeleteTasks();
+  for (unsigned char i = 0; i < count; i++) {
+    Controller::AddTask(2 + i % (DEVICE_NUMBERS - 2), 1000UL + i * 600UL, 400, 0, 0);
+  }
+}
+
+
+// pass the next byte of the serial load to the firmware
+static void load() {
+#if defined(__AVR__)
+  // nothing arrives on the UART - receive the load at line speed,
+  // SerialCom::Loop parses it within the timed serial_loop
+  if (micros() - loadTime < BENCH_BYTE_US) {
+    return;
+  }
+  loadTime = micros();
+  SerialCom::Receive(loadLine[loadPos++]);
+  if (loadLine[loadPos] == '\0') {
+    loadPos = 0;
+  }
+#else
+  // the stand-in UART delivers the bytes at line speed
+  if (NativeHal::SerialPending() == 0) {
+    NativeHal::SerialSend(loadLine, strlen(loadLine));
+  }
+#endif
+  // keep room in the staging table
+  if (Controller::GetTaskCount() >= MAX_TASKS - 1) {
+    Controller::DeleteTasks();
+  }
+}
+
+
+// drain the log and the serial line
+static void settle() {
+  for (unsigned short i = 0; i < 1000; i++) {
+    SerialCom::Loop();
+    pace();
+  }
+}
+
+
+/*
+ * Benchmarks
+ */
+static void benchClock() {
+  Result* result = begin(PSTR("clock"), 0, 0);
+  for (unsigned short i = 0; i < BENCH_REPEAT; i++) {
+    unsigned long start = clockNow();
+    record(result, clockNow() - start);
+  }
+}
+
+
+static void benchParse(const unsigned char timings) {
+  char line[BENCH_LINE_SIZE];
+  unsigned char length = setLine(line, 2, timings);
+  Result* result = begin(PSTR("parse_set"), timings, length);
+  for (unsigned short i = 0; i < BENCH_REPEAT; i++) {
+    Controller::DeleteTasks();
+    unsigned long start = clockNow();
+    for (const char* p = line; *p != '\0'; p++) {
+      Command::Feed(*p);
+    }
+    record(result, clockNow() - start);
+  }
+  if (Controller::GetTaskCount() != timings) {
+    result->Count = 0; // rejected - reported without timing
+  }
+}
+
+
+// the small tables of the Uno and the host build are refilled until enough
+// calls are timed - the clearing is not timed
+static void benchAddTask() {
+  Result* result = begin(PSTR("add_task"), MAX_TASKS, 0);
+  bool added = true;
+  Controller::DeleteTasks();
+  for (unsigned short i = 0; i < BENCH_ADDS; i++) {
+    unsigned char index = Controller::GetTaskCount();
+    if (index >= MAX_TASKS) {
+      Controller::DeleteTasks();
+      index = 0;
+    }
+    unsigned long start = clockNow();
+    added &= Controller::AddTask(2 + index % (DEVICE_NUMBERS - 2), 1000UL + index * 600UL, 400, 0, 0);
+    record(result, clockNow() - start);
+  }
+  Controller::DeleteTasks();
+  if (!added) {
+    result->Count = 0; // rejected - reported without timing
+  }
+}
+
+
+static void benchCommit(const unsigned char count) {
+  stage(count);
+  Result* result = begin(PSTR("commit"), count, 0);
+  for (unsigned char i = 0; i < BENCH_COMMITS; i++) {
+    unsigned long start = clockNow();
+    Controller::ReqCommit();
+    record(result, clockNow() - start);
+  }
+}
+
+
+static void benchLoop(const unsigned char mode) {
+  stage(MAX_TASKS < 16 ? MAX_TASKS : 16);
+  Controller::ReqCommit();
+  Controller::SetExecMode(mode);
+  Controller::ReqRun(255, 5);
+  setLine(loadLine, 2, 3);
+  Result* controller = begin(PSTR("controller_loop"), mode, 0);
+  Result* serial = begin(PSTR("serial_loop"), mode, 0);
+  for (unsigned short i = 0; i < BENCH_PASSES; i++) {
+    load();
+    unsigned long start = clockNow();
+    Controller::Loop();
+    unsigned long middle = clockNow();
+    SerialCom::Loop();
+    unsigned long end = clockNow();
+    record(controller, middle - start);
+    record(serial, end - middle);
+    pace();
+  }
+  Controller::ReqCancel();
+  while (Controller::IsRunning()) {
+    Controller::Loop();
+    SerialCom::Loop();
+    pace();
+  }
+  Controller::DeleteTasks();
+}
+
+
+static void benchMemory() {
+  Result* result = begin(PSTR("free_memory"), 0, 0);
+  for (unsigned short i = 0; i < BENCH_REPEAT; i++) {
+    unsigned long start = clockNow();
+    freeMemory();
+    record(result, clockNow() - start);
+  }
+  result = begin(PSTR("min_free_memory"), 0, 0);
+  for (unsigned short i = 0; i < BENCH_REPEAT; i++) {
+    unsigned long start = clockNow();
+    minFreeMemory();
+    record(result, clockNow() - start);
+  }
+}
+
+
+void setup() {
+  paintFreeMemory();
+  SerialCom::Setup();
+  Controller::Setup();
+  SerialCom::SetLogLevel(ERROR);
+  clockSetup();
+
+  benchClock();
+  benchParse(1);
+  benchParse(4);
+  benchParse(8);
+  benchAddTask();
+  for (unsigned char count = 8; count < MAX_TASKS; count *= 2) {
+    benchCommit(count);
+  }
+  benchCommit(MAX_TASKS);
+  benchLoop(EXEC_POLLED);
+  benchLoop(EXEC_TIMER);
+  benchMemory();
+
+  settle();
+  report();
+}
+
+
+void loop() {
+}
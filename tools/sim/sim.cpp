@@ -0,0 +1,254 @@
+ /*******************************************************************************
+ * Project: ArduDrop - Toolkit for Liquid Art Photographers
+ * Copyright (C) 2021 Holger Pasligh
+ * 
+ * This program incorporates a modified version of "Droplet - Toolkit for Liquid Art Photographers"
+ * Copyright (C) 2012 Stefan Brenner
+ *
+ * This file is part of ArduDrop.
+ *
+ * ArduDrop is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduDrop is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ArduDrop. If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/*
+ * Scheduler simulation with VCD export
+ * Plays a recorded serial session into the firmware on the virtual clock of
+ * lib/NativeHal and writes every level change of the device pins to a VCD
+ * file for GTKWave. Controller::Loop and SerialCom::Loop are called like
+ * loop() does, each call consumes its modelled cost on the clock.
+ *
+ * usage: sim [-t seconds] [-c us] [-s us] [-b us] [-o file] [session]
+ *   -t  max virtual run time, default 10s - the simulation ends earlier
+ *       when the session is sent, every reply is out and no task runs for
+ *       200ms
+ *   -c  cost of one Controller::Loop call, default 5us
+ *   -s  cost of one SerialCom::Loop call, default 5us
+ *   -b  additional cost per received byte SerialCom::Loop takes, default 2us
+ *   -o  VCD file, default ardudrop.vcd
+ *
+ * The session is read from the given file or stdin, one command per line.
+ * Empty lines and lines starting with "# " are skipped - a # followed by a
+ * digit starts a SequencedCommand and is sent. A line @ms holds back the
+ * following lines until the virtual clock reached ms.
+ */
+
+#include <Arduino.h>
+#include <unistd.h>
+
+#include "NativeHal.h"
+#include "board.h"
+#include "controller.h"
+#include "serialcom.h"
+#include "stats.h"
+
+#define SIM_IDLE_END  200 // ms without task after the session before the end
+
+
+static FILE* vcd = NULL;
+static uint8_t levels[DEVICE_NUMBERS];
+static uint64_t lastDump = 0;
+static unsigned long edges = 0;
+
+
+// level of a device pin as driven by the firmware
+static uint8_t level(const unsigned char device) {
+  volatile uint8_t *out = portOutputRegister(devicePins[device].Port);
+  return (*out & devicePins[device].Mask) ? 1 : 0;
+}
+
+
+// VCD identifier of a device - printable characters from '!'
+static char ident(const unsigned char device) {
+  return '!' + device;
+}
+
+
+// picoseconds since the start
+static uint64_t picos(const uint64_t cycles) {
+  return cycles * (1000000000000ULL / F_CPU);
+}
+
+
+static void writeHeader() {
+  fprintf(vcd, "$version ArduDrop scheduler simulation $end\n");
+  fprintf(vcd, "$timescale 1ps $end\n");
+  fprintf(vcd, "$scope module ardudrop $end\n");
+  for (unsigned char i = 0; i < DEVICE_NUMBERS; i++) {
+    fprintf(vcd, "$var wire 1 %c device%u $end\n", ident(i), i);
+  }
+  fprintf(vcd, "$upscope $end\n");
+  fprintf(vcd, "$enddefinitions $end\n");
+  fprintf(vcd, "#0\n$dumpvars\n");
+  for (unsigned char i = 0; i < DEVICE_NUMBERS; i++) {
+    levels[i] = level(i);
+    fprintf(vcd, "%u%c\n", levels[i], ident(i));
+  }
+  fprintf(vcd, "$end\n");
+}
+
+
+// write the pins changed since the last call - runs before the clock moves
+// and after every interrupt, so an edge is stamped with the cycle it was made
+static void sample() {
+  uint64_t now = NativeHal::Cycles();
+  for (unsigned char i = 0; i < DEVICE_NUMBERS; i++) {
+    uint8_t current = level(i);
+    if (current == levels[i]) {
+      continue;
+    }
+    if (now != lastDump) {
+      fprintf(vcd, "#%llu\n", (unsigned long long)picos(now));
+      lastDump = now;
+    }
+    fprintf(vcd, "%u%c\n", current, ident(i));
+    levels[i] = current;
+    edges++;
+  }
+}
+
+
+static void drainOutput() {
+  char output[256];
+  size_t received;
+  while ((received = NativeHal::SerialReceive(output, sizeof(output))) > 0) {
+    fwrite(output, 1, received, stdout);
+  }
+}
+
+
+int main(int argc, char** argv) {
+  unsigned long runTime = 10;
+  unsigned long controllerCost = 5;
+  unsigned long serialCost = 5;
+  unsigned long byteCost = 2;
+  const char* vcdName = "ardudrop.vcd";
+  int option;
+  while ((option = getopt(argc, argv, "t:c:s:b:o:")) != -1) {
+    switch (option)
+    {
+    case 't':
+      runTime = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      controllerCost = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      serialCost = strtoul(optarg, NULL, 10);
+      break;
+    case 'b':
+      byteCost = strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      vcdName = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t seconds] [-c us] [-s us] [-b us] [-o file] [session]\n", argv[0]);
+      return 1;
+    }
+  }
+  FILE* session = stdin;
+  if (optind < argc) {
+    session = fopen(argv[optind], "r");
+    if (session == NULL) {
+      perror(argv[optind]);
+      return 1;
+    }
+  }
+  vcd = fopen(vcdName, "w");
+  if (vcd == NULL) {
+    perror(vcdName);
+    return 1;
+  }
+
+  NativeHal::Reset();
+  setup();
+  writeHeader();
+  NativeHal::SetClockHook(sample);
+  NativeHal::SetInterruptHook(sample);
+
+  // lines of any length - they are streamed in as the RX queue has room
+  char* line = NULL;
+  size_t lineCapacity = 0;
+  size_t lineLength = 0;
+  size_t sent = 0;
+  bool lineReady = false;
+  bool sessionDone = false;
+  uint64_t holdUntil = 0;
+  uint64_t idleSince = 0;
+  uint64_t end = (uint64_t)runTime * F_CPU;
+  while (NativeHal::Cycles() < end) {
+    // queue the next session line once the clock reached its time
+    while (!sessionDone && NativeHal::Cycles() >= holdUntil) {
+      if (!lineReady) {
+        if (getline(&line, &lineCapacity, session) < 0) {
+          sessionDone = true;
+          break;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || (line[0] == '#' && (line[1] == ' ' || line[1] == '\0'))) {
+          continue;
+        }
+        if (line[0] == '@') {
+          holdUntil = strtoull(line + 1, NULL, 10) * (F_CPU / 1000UL);
+          continue;
+        }
+        lineLength = strlen(line);
+        sent = 0;
+        lineReady = true;
+      }
+      size_t room = NATIVE_RX_QUEUE - NativeHal::SerialPending();
+      if (room == 0) {
+        break;
+      }
+      if (sent < lineLength) {
+        size_t chunk = lineLength - sent < room ? lineLength - sent : room;
+        NativeHal::SerialSend(line + sent, chunk);
+        sent += chunk;
+      } else {
+        NativeHal::SerialSend("\n", 1);
+        lineReady = false;
+      }
+    }
+
+    unsigned long start = micros();
+    Controller::Loop();
+    NativeHal::Advance(controllerCost);
+    Stats::Pass(start, micros());
+    unsigned long read = NativeHal::SerialRead();
+    SerialCom::Loop();
+    NativeHal::Advance(serialCost + (NativeHal::SerialRead() - read) * byteCost);
+    drainOutput();
+
+    // stop once the session is played, the controller is idle and every reply is sent
+    if (sessionDone && NativeHal::SerialPending() == 0 && !Controller::IsRunning() &&
+        SerialCom::GetTxPending() == 0 && NativeHal::SerialTxPending() == 0) {
+      if (idleSince == 0) {
+        idleSince = NativeHal::Cycles();
+      } else if (NativeHal::Cycles() - idleSince >= SIM_IDLE_END * (F_CPU / 1000UL)) {
+        break;
+      }
+    } else {
+      idleSince = 0;
+    }
+  }
+  sample();
+  fprintf(vcd, "#%llu\n", (unsigned long long)picos(NativeHal::Cycles()));
+  fclose(vcd);
+  free(line);
+  drainOutput();
+  fflush(stdout);
+  fprintf(stderr, "%lu edges in %lu ms written to %s\n", edges,
+          (unsigned long)(NativeHal::Cycles() / (F_CPU / 1000UL)), vcdName);
+  return 0;
+}